@@ -0,0 +1,98 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* bench-collector is a synthetic collector for `make bench';
+   each run prints -n lines, in a -m mix of SAMPLE, RATE,
+   COUNTER and EVENT (given as relative weights), over -k
+   distinct metric names.
+
+   the last field of every line is the wall clock time, in
+   microseconds, when the line was printed, so that bench-sink
+   can work out how long it took to get through tinybolo. */
+
+static int lines = 1000;
+static int keys  = 100;
+static int mix[4] = { 70, 20, 5, 5 }; /* sample, rate, counter, event */
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-collector -n 1000 -k 100 -m 70,20,5,5\n");
+	exit(1);
+}
+
+static long long now_us(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_REALTIME, &tv);
+	return (long long)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv)
+{
+	int i, w, total;
+	long ts;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			lines = atoi(argv[i]);
+			if (lines < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-k") == 0) {
+			if (!argv[++i]) bail();
+			keys = atoi(argv[i]);
+			if (keys < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-m") == 0) {
+			if (!argv[++i]) bail();
+			if (sscanf(argv[i], "%i,%i,%i,%i", &mix[0], &mix[1], &mix[2], &mix[3]) != 4)
+				bail();
+			continue;
+		}
+		bail();
+	}
+
+	total = mix[0] + mix[1] + mix[2] + mix[3];
+	if (total <= 0 || mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[3] < 0)
+		bail();
+
+	/* a fixed interleaving, rather than rand(), so that every
+	   run (and every build being compared) sees the same mix */
+	ts = (long)time(NULL);
+	for (i = 0; i < lines; i++) {
+		w = (int)((i * 7919L) % total);
+		if ((w -= mix[0]) < 0)
+			printf("SAMPLE %li bench:sample:%i %lli\n", ts, i % keys, now_us());
+		else if ((w -= mix[1]) < 0)
+			printf("RATE %li bench:rate:%i %lli\n", ts, i % keys, now_us());
+		else if ((w -= mix[2]) < 0)
+			printf("COUNTER %li bench:counter:%i %lli\n", ts, i % keys, now_us());
+		else
+			printf("EVENT %li bench:event:%i %lli\n", ts, i % keys, now_us());
+	}
+	return 0;
+}
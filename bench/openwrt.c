@@ -0,0 +1,221 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "collectors.h"
+#include "output.h"
+
+/* bench-openwrt runs the openwrt collectors -r times over a
+   fake /proc (PROC is set to ./bench-proc when this is built)
+   with -n network interfaces and -d disks, printing through
+   the buffered output writer, and through the printf() per
+   metric that openwrt used to do, and reports the CPU time
+   and write() calls each one takes per run. */
+
+static int ifaces = 64;
+static int disks  = 64;
+static int runs   = 1000;
+
+static unsigned long writes = 0;
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-openwrt -n 64 -d 64 -r 1000\n");
+	exit(1);
+}
+
+static double cpu(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tv);
+	return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+static void copy(const char *from, const char *to)
+{
+	char buf[65536];
+	ssize_t n;
+	int in, out;
+
+	in  = open(from, O_RDONLY);
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (in < 0 || out < 0) {
+		perror(in < 0 ? from : to);
+		exit(2);
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n)
+			break;
+	close(in);
+	close(out);
+}
+
+static void build(void)
+{
+	FILE *io;
+	int i;
+
+	mkdir("bench-proc", 0755);
+	mkdir("bench-proc/sys", 0755);
+	mkdir("bench-proc/sys/fs", 0755);
+	mkdir("bench-proc/net", 0755);
+	copy("/proc/meminfo",        "bench-proc/meminfo");
+	copy("/proc/loadavg",        "bench-proc/loadavg");
+	copy("/proc/stat",           "bench-proc/stat");
+	copy("/proc/vmstat",         "bench-proc/vmstat");
+	copy("/proc/sys/fs/file-nr", "bench-proc/sys/fs/file-nr");
+
+	if (!(io = fopen("bench-proc/mounts", "w")))
+		exit(2);
+	fprintf(io, "/dev/root / ext4 rw,relatime 0 0\n");
+	fclose(io);
+
+	if (!(io = fopen("bench-proc/diskstats", "w")))
+		exit(2);
+	for (i = 0; i < disks; i++)
+		fprintf(io, " 8 %i sd%c%c %i 0 %i %i %i 0 %i %i 0 %i %i 0 0 0 0\n",
+			i * 16, 'a' + i / 26 % 26, 'a' + i % 26,
+			i * 1234, i * 56789, i * 12, i * 4321, i * 98765, i * 34, i, i * 1000);
+	fclose(io);
+
+	if (!(io = fopen("bench-proc/net/dev", "w")))
+		exit(2);
+	fprintf(io, "Inter-|   Receive                                                |  Transmit\n"
+	            " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+	for (i = 0; i < ifaces; i++)
+		fprintf(io, "veth%04x: %i %i 0 0 0 0 0 %i %i %i 0 0 0 0 0 0\n",
+			i * 7919, i * 123456789, i * 98765, i, i * 87654321, i * 76543);
+	fclose(io);
+}
+
+static void teardown(void)
+{
+	const char *f[] = { "meminfo", "loadavg", "stat", "vmstat", "sys/fs/file-nr",
+	                    "mounts", "diskstats", "net/dev", NULL };
+	char path[64];
+	int i;
+
+	for (i = 0; f[i]; i++) {
+		snprintf(path, sizeof(path), "bench-proc/%s", f[i]);
+		unlink(path);
+	}
+	rmdir("bench-proc/sys/fs");
+	rmdir("bench-proc/sys");
+	rmdir("bench-proc/net");
+	rmdir("bench-proc");
+}
+
+/* the way openwrt used to print, through a FILE that counts
+   its write()s and throws the data away */
+static ssize_t counted(void *c, const char *buf, size_t n)
+{
+	writes++;
+	return n;
+}
+
+static void print_metric(struct emitter *e, const char *type, int32_t ts, const char *name, const char *value)
+{
+	FILE *io = e->data;
+	if (strcmp(type, "KEY") == 0)
+		fprintf(io, "KEY %s:%s %s\n", e->prefix, name, value);
+	else
+		fprintf(io, "%s %i %s:%s %s\n", type, ts, e->prefix, name, value);
+}
+
+static void report(const char *what, double t, unsigned long w)
+{
+	printf("%-8s %4i ifaces %4i disks  %8.1f us/run  %6.1f write()s/run\n",
+		what, ifaces, disks, t * 1e6 / runs, (double)w / runs);
+}
+
+int main(int argc, char **argv)
+{
+	cookie_io_functions_t fns = { .write = counted };
+	struct emitter e = { .prefix = "router1.example.com" };
+	struct output out;
+	FILE *io;
+	double t;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			ifaces = atoi(argv[i]);
+			if (ifaces < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-d") == 0) {
+			if (!argv[++i]) bail();
+			disks = atoi(argv[i]);
+			if (disks < 0 || disks > 676) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-r") == 0) {
+			if (!argv[++i]) bail();
+			runs = atoi(argv[i]);
+			if (runs < 1) bail();
+			continue;
+		}
+		bail();
+	}
+
+	build();
+
+	io = fopencookie(NULL, "w", fns);
+	if (!io) {
+		teardown();
+		exit(2);
+	}
+	e.metric = print_metric;
+	e.data   = io;
+	collect_all(&e); /* once to open everything */
+	fflush(io);
+	writes = 0;
+	t = cpu();
+	for (i = 0; i < runs; i++) {
+		collect_all(&e);
+		fflush(io);
+	}
+	t = cpu() - t;
+	report("printf", t, writes);
+	fclose(io);
+
+	output_init(&out, open("/dev/null", O_WRONLY));
+	e.metric = output_metric;
+	e.data   = &out;
+	t = cpu();
+	for (i = 0; i < runs; i++) {
+		collect_all(&e);
+		output_flush(&out);
+	}
+	t = cpu() - t;
+	report("buffered", t, out.writes);
+
+	teardown();
+	return 0;
+}
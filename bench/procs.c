@@ -0,0 +1,205 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "procs.h"
+
+/* bench-procs builds a fake process directory of -n processes
+   (with names that have spaces and parentheses in them, as
+   real ones can), and times procs_scan() over it, single-
+   threaded and then with -t threads, against the readdir() /
+   fopen() / fgets() loop that collect_procs() used to be. */
+
+static int procs = 30000;
+static int threads = 4;
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-procs -n 30000 -t 4\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+static const char states[] = "RSSSSSDZTW";
+
+static void build(const char *root)
+{
+	char path[256];
+	FILE *io;
+	int i;
+
+	for (i = 1; i <= procs; i++) {
+		snprintf(path, sizeof(path), "%s/%i", root, i);
+		if (mkdir(path, 0755) != 0) {
+			perror(path);
+			exit(2);
+		}
+		snprintf(path, sizeof(path), "%s/%i/stat", root, i);
+		if (!(io = fopen(path, "w"))) {
+			perror(path);
+			exit(2);
+		}
+		fprintf(io, "%i (%s) %c 1 %i %i 0 -1 4194560 1234 0 0 0 56 78 0 0 20 0 1 0 %i\n",
+			i, i % 3 ? "worker" : "kworker/u8:2 (x) y", states[i % 10], i, i, i * 10);
+		fclose(io);
+	}
+	/* things that aren't processes */
+	snprintf(path, sizeof(path), "%s/self", root);     mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/sys", root);      mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/meminfo", root);  fclose(fopen(path, "w"));
+}
+
+static void teardown(const char *root)
+{
+	char path[256];
+	int i;
+
+	for (i = 1; i <= procs; i++) {
+		snprintf(path, sizeof(path), "%s/%i/stat", root, i); unlink(path);
+		snprintf(path, sizeof(path), "%s/%i", root, i);      rmdir(path);
+	}
+	snprintf(path, sizeof(path), "%s/self", root);    rmdir(path);
+	snprintf(path, sizeof(path), "%s/sys", root);     rmdir(path);
+	snprintf(path, sizeof(path), "%s/meminfo", root); unlink(path);
+	rmdir(root);
+}
+
+/* the way collect_procs() used to do it */
+static void naive(const char *root, struct procstates *P)
+{
+	char buf[8192], *file, *a;
+	struct dirent *dir;
+	FILE *io;
+	DIR *d;
+	int pid;
+
+	memset(P, 0, sizeof(*P));
+	if (!(d = opendir(root)))
+		return;
+	while ((dir = readdir(d)) != NULL) {
+		if (!isdigit(dir->d_name[0])
+		 || (pid = atoi(dir->d_name)) < 1)
+			continue;
+		if (asprintf(&file, "%s/%i/stat", root, pid) < 0)
+			continue;
+		io = fopen(file, "r");
+		free(file);
+		if (!io)
+			continue;
+		if (!fgets(buf, 8192, io)) {
+			fclose(io);
+			continue;
+		}
+		fclose(io);
+
+		a = buf;
+		while (*a && !isspace(*a)) a++;
+		while (*a &&  isspace(*a)) a++;
+		while (*a && !isspace(*a)) a++;
+		while (*a &&  isspace(*a)) a++;
+		switch (*a) {
+		case 'R': P->running++;  break;
+		case 'S': P->sleeping++; break;
+		case 'D': P->blocked++;  break;
+		case 'Z': P->zombies++;  break;
+		case 'T': P->stopped++;  break;
+		case 'W': P->paging++;   break;
+		default:  P->unknown++;  break;
+		}
+	}
+	closedir(d);
+}
+
+static void report(const char *what, struct procstates *P, double t)
+{
+	printf("%-12s %8i procs  %8.1f ms  %6.2f us/proc  "
+	       "R %u  S %u  D %u  Z %u  T %u  W %u  ? %u\n",
+		what, procs, t * 1e3, t * 1e6 / procs,
+		P->running, P->sleeping, P->blocked, P->zombies,
+		P->stopped, P->paging, P->unknown);
+}
+
+int main(int argc, char **argv)
+{
+	struct procstates P;
+	char root[] = "/tmp/bench-procs.XXXXXX", what[32];
+	double t;
+	int i, fd;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			procs = atoi(argv[i]);
+			if (procs < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-t") == 0) {
+			if (!argv[++i]) bail();
+			threads = atoi(argv[i]);
+			if (threads < 1) bail();
+			continue;
+		}
+		bail();
+	}
+
+	if (!mkdtemp(root)) {
+		perror(root);
+		exit(2);
+	}
+	build(root);
+
+	if ((fd = procs_open(root)) < 0) {
+		perror(root);
+		teardown(root);
+		exit(2);
+	}
+
+	/* once to warm the dentry cache, for everyone */
+	naive(root, &P);
+
+	t = now(); naive(root, &P); t = now() - t;
+	report("readdir", &P, t);
+
+	t = now(); procs_scan(fd, &P, 1); t = now() - t;
+	report("getdents", &P, t);
+
+	snprintf(what, sizeof(what), "getdents x%i", threads);
+	t = now(); procs_scan(fd, &P, threads); t = now() - t;
+	report(what, &P, t);
+
+	close(fd);
+	teardown(root);
+	return 0;
+}
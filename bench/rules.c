@@ -0,0 +1,123 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "rules.h"
+
+/* bench-rules times the metric: rule matcher over -n metric
+   names, shaped like what the openwrt collector prints, against
+   no rules, and then against a set of -k exclude / rename rules,
+   to show what filtering costs per metric. */
+
+static int names = 100000;
+static int nrules = 20;
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-rules -n 100000 -k 20\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+static const char *shapes[] = {
+	"router%i.example.com:diskio:dm-%i:read.bytes",
+	"router%i.example.com:diskio:sda%i:write.iops",
+	"router%i.example.com:net:veth%i:rx.bytes",
+	"router%i.example.com:net:eth%i:tx.packets",
+	"router%i.example.com:df:/run/user/%i:bytes.free",
+	"router%i.example.com:df:/srv/%i:inodes.total",
+	"router%i.example.com:cpu:core%i:user",
+	"router%i.example.com:memory:slab%i",
+	NULL
+};
+
+static void run(const char *what, struct rules *r, char **name)
+{
+	char buf[1024];
+	unsigned long kept = 0;
+	double t;
+	int i;
+
+	t = now();
+	for (i = 0; i < names; i++)
+		if (rules_apply(r, name[i], buf, sizeof(buf)))
+			kept++;
+	t = now() - t;
+	printf("%-10s %3i rules  %8i names  %8lu kept  %6.1f ns/name\n",
+		what, r->n, names, kept, t * 1e9 / names);
+}
+
+int main(int argc, char **argv)
+{
+	struct rules *none, *some;
+	char **name, spec[256];
+	int i, n;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			names = atoi(argv[i]);
+			if (names < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-k") == 0) {
+			if (!argv[++i]) bail();
+			nrules = atoi(argv[i]);
+			if (nrules < 4) bail();
+			continue;
+		}
+		bail();
+	}
+
+	name = calloc(names, sizeof(char *));
+	none = rules_new();
+	some = rules_new();
+	if (!name || !none || !some) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	for (n = 0; shapes[n]; n++);
+	for (i = 0; i < names; i++) {
+		name[i] = malloc(128);
+		snprintf(name[i], 128, shapes[i % n], i / n % 1000, i % 7);
+	}
+
+	rules_add(some, "exclude *:diskio:dm-*");
+	rules_add(some, "exclude *:net:veth*");
+	rules_add(some, "exclude *:df:/run*");
+	rules_add(some, "rename *:net:eth0:* *:net:wan:*");
+	for (i = 4; i < nrules; i++) {
+		snprintf(spec, sizeof(spec), "exclude router%i.example.com:*", i * 37);
+		rules_add(some, spec);
+	}
+
+	run("no rules", none, name);
+	run("rules",    some, name);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+#  Copyright 2015 James Hunt <james@jameshunt.us>
+#
+#  This file is part of tinybolo.
+#
+#  tinybolo is free software: you can redistribute it and/or modify it under the
+#  terms of the GNU General Public License as published by the Free Software
+#  Foundation, either version 3 of the License, or (at your option) any later
+#  version.
+#
+#  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+#  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+#  details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# run tinybolo against bench-collector and bench-sink, and
+# report throughput, end-to-end latency, and what it cost us.
+#
+#   bench/run.sh [BUILDDIR]
+#
+# tunables (environment variables):
+#
+#   BENCH_SECONDS   30           how long to run tinybolo for
+#   BENCH_INTERVAL  1            collector interval, in seconds
+#   BENCH_LINES     10000        lines per collector run
+#   BENCH_KEYS      100          distinct metric names per type
+#   BENCH_MIX       70,20,5,5    SAMPLE,RATE,COUNTER,EVENT weights
+#   BENCH_FLAGS     (none)       extra tinybolo flags, i.e. "-b 256 -z lz4"
+
+set -e
+bin=${1:-.}
+secs=${BENCH_SECONDS:-30}
+tmp=$(mktemp -d ${TMPDIR:-/tmp}/tinybolo-bench.XXXXXX)
+sock=ipc://$tmp/sink.sock
+agent= sink=
+trap 'kill $agent $sink 2>/dev/null || true; rm -rf $tmp' EXIT
+trap 'exit 1' INT TERM
+
+cat > $tmp/tinybolo.conf <<EOF
+interval=${BENCH_INTERVAL:-1} name=bench $bin/bench-collector -n ${BENCH_LINES:-10000} -k ${BENCH_KEYS:-100} -m ${BENCH_MIX:-70,20,5,5}
+EOF
+
+$bin/bench-sink -l $sock > $tmp/sink.out &
+sink=$!
+sleep 1
+
+$bin/tinybolo -F -n -i $secs -c $tmp/tinybolo.conf -e $sock ${BENCH_FLAGS} 2>$tmp/tinybolo.err &
+agent=$!
+sleep $secs
+
+# utime, stime, cutime and cstime, in clock ticks
+set -- $(sed -e 's/.*) //' /proc/$agent/stat)
+hz=$(getconf CLK_TCK)
+cpu=$(( ${12} + ${13} ))
+ccpu=$(( ${14} + ${15} ))
+rss=$(awk '/^VmHWM:/ { print $2 }' /proc/$agent/status)
+
+kill $agent; wait $agent 2>/dev/null || true
+sleep 1
+kill $sink;  wait $sink  2>/dev/null || true
+agent= sink=
+
+echo "tinybolo ${BENCH_FLAGS:-(defaults)}, ${BENCH_LINES:-10000} lines every ${BENCH_INTERVAL:-1}s for ${secs}s"
+cat $tmp/sink.out
+awk -v c=$cpu -v cc=$ccpu -v hz=$hz -v s=$secs -v rss=$rss 'BEGIN {
+	printf "cpu_s   %0.2f (%0.1f%% of one core)\n", c / hz, 100 * c / hz / s
+	printf "child_s %0.2f\n", cc / hz
+	printf "rss_kb  %i\n", rss
+}'
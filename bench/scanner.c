@@ -0,0 +1,156 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "scanner.h"
+
+/* bench-scanner times how fast collector output can be split
+   into lines and fields, the old way (stdio fgets() into a
+   fixed buffer, then isspace() loops) and with the scanner
+   tinybolo uses now, over the same -n lines of synthetic
+   collector output, -r times each. */
+
+static int lines  = 500000;
+static int rounds = 5;
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-scanner -n 500000 -r 5\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+/* keep the compiler from optimizing the fields away */
+static unsigned long sink;
+
+static unsigned long old_way(int fd)
+{
+	char buf[8192], *a, *b;
+	unsigned long n = 0;
+	FILE *io = fdopen(dup(fd), "r");
+	int i;
+
+	while (fgets(buf, sizeof(buf), io) != NULL) {
+		b = buf;
+		for (i = 0; i < 4; i++) {
+			for (a = b; *a &&  isspace(*a); a++);
+			if (!*a) break;
+			for (b = a; *b && !isspace(*b); b++);
+			if (*b) *b++ = '\0';
+			sink += *a;
+		}
+		n++;
+	}
+	fclose(io);
+	return n;
+}
+
+static unsigned long new_way(int fd)
+{
+	struct scanner s = { 0 };
+	unsigned long n = 0;
+	char *line, *f;
+	int i;
+
+	scanner_init(&s, fd, 1024 * 1024);
+	while ((line = scanner_line(&s, NULL)) != NULL) {
+		for (i = 0; i < 4 && (f = scanner_field(&line)) != NULL; i++)
+			sink += *f;
+		n++;
+	}
+	scanner_free(&s);
+	return n;
+}
+
+static void run(const char *what, unsigned long (*fn)(int), int fd, off_t size)
+{
+	double t, best = 0;
+	unsigned long n = 0;
+	int r;
+
+	for (r = 0; r < rounds; r++) {
+		lseek(fd, 0, SEEK_SET);
+		t = now();
+		n = fn(fd);
+		t = now() - t;
+		if (!r || t < best)
+			best = t;
+	}
+	printf("%-8s %8lu lines  %8.1f MB/s  %6.1f ns/line\n", what, n,
+		size / best / 1e6, best * 1e9 / n);
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "/tmp/bench-scanner.XXXXXX";
+	FILE *io;
+	off_t size;
+	int i, fd;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			lines = atoi(argv[i]);
+			if (lines < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-r") == 0) {
+			if (!argv[++i]) bail();
+			rounds = atoi(argv[i]);
+			if (rounds < 1) bail();
+			continue;
+		}
+		bail();
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror(path);
+		exit(2);
+	}
+	unlink(path);
+
+	io = fdopen(dup(fd), "w");
+	for (i = 0; i < lines; i++)
+		if (i % 10 == 9)
+			fprintf(io, "EVENT 1434567890 host.example.com:log:%i something happened, in a fair few words, to line %i\n", i % 100, i);
+		else
+			fprintf(io, "SAMPLE 1434567890 host.example.com:disk:/var/lib/%i:used %i.%02i\n", i % 100, i, i % 100);
+	fclose(io);
+	size = lseek(fd, 0, SEEK_END);
+
+	run("fgets",   old_way, fd, size);
+	run("scanner", new_way, fd, size);
+	close(fd);
+	return 0;
+}
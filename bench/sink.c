@@ -0,0 +1,237 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <zmq.h>
+
+#include "metric.h"
+#include "batch.h"
+#include "compress.h"
+
+/* bench-sink stands in for bolo during `make bench'; it binds
+   a PULL socket, takes whatever tinybolo sends it (batched,
+   compressed or otherwise), and times the arrival of every
+   metric printed by bench-collector.  When it is interrupted,
+   or has been idle for -w seconds, it prints a summary:
+
+     metrics 120000
+     seconds 12.003
+     rate    9997.5
+     p50_us  812
+     p99_us  4410
+     max_us  9876
+
+   Metrics that bench-collector didn't print (i.e. tinybolo's
+   own) are counted separately, as `other'. */
+
+static char *bind_to = "ipc:///tmp/bench-sink.sock";
+static int   idle    = 0; /* seconds (0 = wait for a signal) */
+
+static volatile sig_atomic_t done = 0;
+
+static int64_t *lat = NULL; /* latencies, in microseconds */
+static size_t   nlat = 0, caplat = 0;
+static unsigned long other = 0;
+static int64_t  first = 0, last = 0;
+
+#define MAX_FRAMES 8
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-sink -l ipc:///tmp/bench-sink.sock [-w 0]\n");
+	exit(1);
+}
+
+static void on_signal(int sig)
+{
+	done = 1;
+}
+
+static int64_t now_us(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_REALTIME, &tv);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+static void arrived(const char *name, const char *value, int64_t t)
+{
+	if (strncmp(name, "bench:", 6) != 0) {
+		other++;
+		return;
+	}
+
+	if (nlat == caplat) {
+		int64_t *p = realloc(lat, (caplat = caplat ? caplat * 2 : 65536) * sizeof(int64_t));
+		if (!p) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+		lat = p;
+	}
+	lat[nlat++] = t - strtoll(value, NULL, 10);
+	if (!first)
+		first = t;
+	last = t;
+}
+
+static void unbatch(const char *blob, size_t len, int64_t t)
+{
+	struct metric *m;
+	size_t off = 0;
+
+	while ((m = batch_next(blob, len, &off)) != NULL) {
+		if (m->n >= 4)
+			arrived(m->frame[2], m->frame[m->n - 1], t);
+		free(m);
+	}
+}
+
+static int cmp(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void summarize(void)
+{
+	double secs = (last - first) / 1000000.0;
+
+	qsort(lat, nlat, sizeof(int64_t), cmp);
+	printf("metrics %lu\n", (unsigned long)nlat);
+	printf("other   %lu\n", other);
+	printf("seconds %0.3f\n", secs);
+	printf("rate    %0.1f\n", secs > 0 ? nlat / secs : 0.0);
+	if (nlat) {
+		printf("p50_us  %lli\n", (long long)lat[nlat / 2]);
+		printf("p99_us  %lli\n", (long long)lat[nlat * 99 / 100]);
+		printf("max_us  %lli\n", (long long)lat[nlat - 1]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int i, n, rc;
+	void *zmq, *in;
+	zmq_msg_t frames[MAX_FRAMES];
+	char *buf = NULL;   /* for decompressing into */
+	size_t cap = 0;
+	int64_t t;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-l") == 0) {
+			if (!argv[++i]) bail();
+			bind_to = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-w") == 0) {
+			if (!argv[++i]) bail();
+			idle = atoi(argv[i]);
+			continue;
+		}
+		bail();
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to create a 0MQ context: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	in = zmq_socket(zmq, ZMQ_PULL);
+	if (!in || zmq_bind(in, bind_to) != 0) {
+		fprintf(stderr, "failed to bind to '%s': %s\n", bind_to, zmq_strerror(errno));
+		exit(2);
+	}
+	rc = idle > 0 ? idle * 1000 : -1;
+	zmq_setsockopt(in, ZMQ_RCVTIMEO, &rc, sizeof(rc));
+
+	while (!done) {
+		for (n = 0; ; ) {
+			zmq_msg_t discard, *msg = n < MAX_FRAMES ? &frames[n] : &discard;
+			zmq_msg_init(msg);
+			rc = zmq_msg_recv(msg, in, 0);
+			if (rc < 0) {
+				zmq_msg_close(msg);
+				break;
+			}
+			int more = zmq_msg_more(msg);
+			if (msg == &discard)
+				zmq_msg_close(msg);
+			else
+				n++;
+			if (!more)
+				break;
+		}
+		t = now_us();
+		if (rc < 0) {
+			for (i = 0; i < n; i++)
+				zmq_msg_close(&frames[i]);
+			if (errno == EAGAIN && nlat)
+				break; /* idle for long enough */
+			continue;
+		}
+
+		/* frame 0 is the (empty) envelope */
+		int algo = n == 3 ? compress_frame(zmq_msg_data(&frames[1]), zmq_msg_size(&frames[1])) : -1;
+		if (algo > 0) {
+			const char *blob = zmq_msg_data(&frames[2]);
+			size_t len = zmq_msg_size(&frames[2]), want = compress_length(blob, len);
+
+			if (want > cap) {
+				free(buf);
+				buf = malloc(cap = want);
+				if (!buf)
+					cap = 0;
+			}
+			len = buf ? decompress(algo, blob, len, buf, cap) : 0;
+			if (len)
+				unbatch(buf, len, t);
+
+		} else if (n == 3 && zmq_msg_size(&frames[1]) == sizeof(BATCH_FRAME)
+		 && memcmp(zmq_msg_data(&frames[1]), BATCH_FRAME, sizeof(BATCH_FRAME)) == 0) {
+			unbatch(zmq_msg_data(&frames[2]), zmq_msg_size(&frames[2]), t);
+
+		} else if (n >= 5) {
+			/* ["", TYPE, TS, NAME, VALUE...]; frames are NUL-terminated */
+			arrived(zmq_msg_data(&frames[3]), zmq_msg_data(&frames[n - 1]), t);
+		}
+
+		for (i = 0; i < n; i++)
+			zmq_msg_close(&frames[i]);
+	}
+
+	summarize();
+	zmq_close(in);
+	zmq_ctx_destroy(zmq);
+	return 0;
+}
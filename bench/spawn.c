@@ -0,0 +1,135 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "launch.h"
+
+/* bench-spawn times how long it takes to start (and reap) a
+   trivial collector, -n times, three ways: fork() + /bin/sh
+   (how tinybolo used to do it), posix_spawn() + /bin/sh, and
+   posix_spawn() of the command itself (how tinybolo runs
+   simple commands now).  -m makes us allocate (and touch)
+   that many megabytes first, since the cost of fork() grows
+   with the size of the process doing it. */
+
+static int   runs    = 500;
+static int   ballast = 0;
+static char *cmd     = "true";
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: bench-spawn -n 500 -m 0 [-c true]\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+static pid_t forked(int null)
+{
+	pid_t pid = fork();
+	if (pid == 0) {
+		setpgid(0, 0);
+		dup2(null, 0);
+		dup2(null, 1);
+		dup2(null, 2);
+		execl("/bin/sh", "sh", "-c", cmd, NULL);
+		exit(127);
+	}
+	return pid;
+}
+
+static void run(const char *what, char **argv, int null)
+{
+	double t = now();
+	pid_t pid;
+	int i, st;
+
+	for (i = 0; i < runs; i++) {
+		pid = argv ? launch(argv, null, null, null) : forked(null);
+		if (pid < 0) {
+			perror(what);
+			exit(2);
+		}
+		waitpid(pid, &st, 0);
+	}
+	t = now() - t;
+	printf("%-12s %6i runs  %8.1f us/run\n", what, runs, t * 1e6 / runs);
+}
+
+int main(int argc, char **argv)
+{
+	char **direct, **shell;
+	int i, null;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) {
+			if (!argv[++i]) bail();
+			runs = atoi(argv[i]);
+			if (runs < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-m") == 0) {
+			if (!argv[++i]) bail();
+			ballast = atoi(argv[i]);
+			continue;
+		}
+		if (strcmp(argv[i], "-c") == 0) {
+			if (!argv[++i]) bail();
+			cmd = argv[i];
+			continue;
+		}
+		bail();
+	}
+
+	if (ballast > 0) {
+		char *p = malloc((size_t)ballast << 20);
+		if (!p) {
+			perror("ballast");
+			exit(2);
+		}
+		memset(p, 1, (size_t)ballast << 20);
+	}
+
+	null = open("/dev/null", O_RDWR | O_CLOEXEC);
+	direct = launch_argv(cmd);
+	shell  = launch_shell(cmd);
+	if (null < 0 || !direct || !shell) {
+		fprintf(stderr, "`%s' needs to be a simple command\n", cmd);
+		exit(1);
+	}
+
+	printf("starting `%s', with %i MB of ballast\n", cmd, ballast);
+	run("fork+sh",  NULL,   null);
+	run("spawn+sh", shell,  null);
+	run("spawn",    direct, null);
+	return 0;
+}
@@ -0,0 +1,297 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "aggregate.h"
+
+#define SERIES_RATE   0
+#define SERIES_ROLLUP 1
+#define SERIES_DEDUP  2
+#define SERIES_DEAD   3 /* to be dropped, on the next flush */
+
+/* forget counters we haven't seen in this long */
+#define STALE_MS (3600 * 1000)
+
+struct series {
+	uint32_t hash;
+	int      kind;
+	int64_t  seen;  /* when we last heard of it (monotonic ms) */
+
+	/* rates (last value), dedup (hash of last value) */
+	uint64_t last;
+
+	/* rollups, and dedup (count of values suppressed) */
+	int64_t  end;   /* when the current window ends */
+	int      window;
+	double   min, max, sum;
+	unsigned long count;
+
+	char     name[];
+};
+
+static uint32_t fnv1a(const char *s)
+{
+	uint32_t h = 2166136261u;
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+	return h;
+}
+
+static uint64_t fnv1a64(const char *s)
+{
+	uint64_t h = 14695981039346656037ull;
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ull;
+	return h;
+}
+
+struct aggregate* aggregate_new(void)
+{
+	struct aggregate *a = calloc(1, sizeof(struct aggregate));
+	if (!a)
+		return NULL;
+
+	a->slots = calloc(256, sizeof(struct series *));
+	if (!a->slots) {
+		free(a);
+		return NULL;
+	}
+	a->mask = 255;
+	return a;
+}
+
+static void place(struct series **slots, size_t mask, struct series *s)
+{
+	size_t i;
+	for (i = s->hash & mask; slots[i]; i = (i + 1) & mask);
+	slots[i] = s;
+}
+
+static int grow(struct aggregate *a)
+{
+	struct series **slots;
+	size_t i, mask = a->mask * 2 + 1;
+
+	slots = calloc(mask + 1, sizeof(struct series *));
+	if (!slots)
+		return 1;
+	for (i = 0; i <= a->mask; i++)
+		if (a->slots[i])
+			place(slots, mask, a->slots[i]);
+	free(a->slots);
+	a->slots = slots;
+	a->mask  = mask;
+	return 0;
+}
+
+/* find the series for `name', creating it if need be;
+   returns NULL only if we are out of memory */
+static struct series* lookup(struct aggregate *a, const char *name, int kind, int *fresh)
+{
+	struct series *s;
+	uint32_t h = fnv1a(name);
+	size_t i;
+
+	for (i = h & a->mask; (s = a->slots[i]) != NULL; i = (i + 1) & a->mask) {
+		if (s->hash != h || strcmp(s->name, name) != 0)
+			continue;
+		*fresh = s->kind != kind;
+		if (*fresh) {
+			memset(&s->last, 0, sizeof(struct series) - offsetof(struct series, last));
+			s->kind = kind;
+		}
+		return s;
+	}
+
+	if ((a->n + 1) * 4 > (a->mask + 1) * 3 && grow(a) != 0)
+		return NULL;
+
+	s = calloc(1, sizeof(struct series) + strlen(name) + 1);
+	if (!s)
+		return NULL;
+	s->hash = h;
+	s->kind = kind;
+	strcpy(s->name, name);
+	place(a->slots, a->mask, s);
+	a->n++;
+	*fresh = 1;
+	return s;
+}
+
+int aggregate_rate(struct aggregate *a, const char *name, const char *value,
+                   int64_t ms, double *rate)
+{
+	struct series *s;
+	uint64_t v, delta;
+	char *end;
+	int fresh;
+
+	errno = 0;
+	v = strtoull(value, &end, 10);
+	if (end == value || *end || errno != 0 || *value == '-')
+		return -1;
+
+	s = lookup(a, name, SERIES_RATE, &fresh);
+	if (!s)
+		return -1;
+
+	if (fresh || ms <= s->seen) {
+		if (fresh) {
+			s->last = v;
+			s->seen = ms;
+		}
+		return 0;
+	}
+
+	if (v >= s->last) {
+		delta = v - s->last;
+	} else if (s->last <= UINT32_MAX && s->last > UINT32_MAX / 2
+	        && v + (UINT32_MAX - s->last) < UINT32_MAX / 2) {
+		delta = v + (UINT32_MAX - s->last) + 1; /* 32-bit wrap */
+	} else {
+		s->last = v; /* reset; start over */
+		s->seen = ms;
+		return 0;
+	}
+
+	*rate = delta * 1000.0 / (ms - s->seen);
+	s->last = v;
+	s->seen = ms;
+	return 1;
+}
+
+int aggregate_sample(struct aggregate *a, const char *name, const char *value,
+                     int64_t ms, int window)
+{
+	struct series *s;
+	double v;
+	char *end;
+	int fresh;
+
+	v = strtod(value, &end);
+	if (end == value || *end)
+		return -1;
+
+	s = lookup(a, name, SERIES_ROLLUP, &fresh);
+	if (!s)
+		return -1;
+
+	if (!s->end) {
+		s->end    = ms + window;
+		s->window = window;
+	}
+	if (!s->count || v < s->min) s->min = v;
+	if (!s->count || v > s->max) s->max = v;
+	s->sum += v;
+	s->count++;
+	s->seen = ms;
+	return 0;
+}
+
+int aggregate_dedup(struct aggregate *a, const char *name, const char *value,
+                    int64_t ms, int every)
+{
+	struct series *s;
+	uint64_t h = fnv1a64(value);
+	int fresh;
+
+	s = lookup(a, name, SERIES_DEDUP, &fresh);
+	if (!s)
+		return 1;
+
+	s->seen = ms;
+	if (!fresh && s->last == h && ++s->count < (unsigned long)every)
+		return 0;
+
+	s->last  = h;
+	s->count = 0;
+	return 1;
+}
+
+int64_t aggregate_flush(struct aggregate *a, int64_t ms,
+                        void (*emit)(const char *name, const char *stat, double v))
+{
+	struct series *s, **slots;
+	int64_t next = -1;
+	size_t i, dropped = 0;
+
+	for (i = 0; i <= a->mask; i++) {
+		s = a->slots[i];
+		if (!s)
+			continue;
+
+		if (s->kind == SERIES_DEAD) {
+			dropped++;
+			continue;
+		}
+		if (s->kind == SERIES_RATE || s->kind == SERIES_DEDUP) {
+			if (ms - s->seen > STALE_MS)
+				goto drop;
+			continue;
+		}
+
+		if (s->end <= ms) {
+			if (!s->count)
+				goto drop; /* a whole window with nothing new */
+
+			emit(s->name, NULL,    s->sum / s->count);
+			emit(s->name, "min",   s->min);
+			emit(s->name, "max",   s->max);
+			emit(s->name, "count", s->count);
+			s->count = 0;
+			s->sum   = 0;
+			while (s->end <= ms)
+				s->end += s->window;
+		}
+		if (next < 0 || s->end < next)
+			next = s->end;
+		continue;
+
+drop:
+		s->kind = SERIES_DEAD;
+		dropped++;
+	}
+
+	/* with linear probing, holes would break up probe runs;
+	   rather than patch those up, move the survivors into a
+	   fresh table (or, if we can't, keep the dead for now) */
+	if (dropped && (slots = calloc(a->mask + 1, sizeof(struct series *))) != NULL) {
+		for (i = 0; i <= a->mask; i++) {
+			if (!(s = a->slots[i]))
+				continue;
+			if (s->kind == SERIES_DEAD)
+				free(s);
+			else
+				place(slots, a->mask, s);
+		}
+		free(a->slots);
+		a->slots = slots;
+		a->n -= dropped;
+	}
+	return next;
+}
+
+unsigned long aggregate_series(struct aggregate *a)
+{
+	return a->n;
+}
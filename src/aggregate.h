@@ -0,0 +1,82 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_AGGREGATE_H
+#define TINYBOLO_AGGREGATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Agent-side aggregation, so that bolo doesn't have to keep
+   per-series state for every host.
+
+   Rates: RATE metrics are monotonic counters.  We remember the
+   last value (and when we saw it) of each one, and send the
+   per-second rate of change as a SAMPLE instead.  Counters that
+   go backwards are taken to have wrapped, if they look like 32-
+   bit counters near the top of their range, or to have been
+   reset otherwise (in which case we start over, and send
+   nothing for that round).
+
+   Rollups: SAMPLE values are folded into min / max / sum / count
+   over a fixed window, and sent once per window.
+
+   Dedup: we remember (a hash of) the last value sent for each
+   series, and hold back repeats, except for every so often, so
+   that bolo doesn't think the series has gone away.
+
+   Series are kept in an open-addressed (linear probing) hash
+   table, keyed by metric name.  Series we haven't heard from in
+   a while are dropped. */
+
+struct series;
+struct aggregate {
+	struct series **slots;
+	size_t          n, mask;
+};
+
+struct aggregate* aggregate_new(void);
+
+/* a counter value; returns 1 and fills in `rate' if there is a
+   rate to send, 0 if not (first sighting, reset, or too soon),
+   or -1 if the value doesn't look like a counter at all. */
+int aggregate_rate(struct aggregate *a, const char *name, const char *value,
+                   int64_t ms, double *rate);
+
+/* a sample, to be rolled up over `window' milliseconds;
+   returns -1 if it doesn't look like a number, 0 otherwise. */
+int aggregate_sample(struct aggregate *a, const char *name, const char *value,
+                     int64_t ms, int window);
+
+/* a value about to be sent; returns 1 if it should be, or 0 if
+   it is the same as last time, and has been for fewer than
+   `every' times in a row. */
+int aggregate_dedup(struct aggregate *a, const char *name, const char *value,
+                    int64_t ms, int every);
+
+/* send rollups for every window that has ended by `ms', by
+   calling `emit' once per statistic, and forget about stale
+   series.  Returns when the next window ends (or -1). */
+int64_t aggregate_flush(struct aggregate *a, int64_t ms,
+                        void (*emit)(const char *name, const char *stat, double v));
+
+unsigned long aggregate_series(struct aggregate *a);
+
+#endif
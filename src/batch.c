@@ -0,0 +1,98 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+int batch_init(struct batch *b, size_t cap)
+{
+	b->buf = malloc(cap);
+	if (!b->buf)
+		return 1;
+	b->cap = cap;
+	batch_reset(b);
+	return 0;
+}
+
+void batch_reset(struct batch *b)
+{
+	b->len   = 0;
+	b->count = 0;
+}
+
+int batch_add(struct batch *b, const struct metric *m)
+{
+	size_t len = 1, n;
+	char *p;
+	int i;
+
+	for (i = 0; i < m->n; i++)
+		len += strlen(m->frame[i]) + 1;
+	if (len > 0xffff || b->len + 2 + len > b->cap)
+		return 1;
+
+	p = b->buf + b->len;
+	*p++ = (len >> 8) & 0xff;
+	*p++ =  len       & 0xff;
+	*p++ = m->n;
+	for (i = 0; i < m->n; i++) {
+		n = strlen(m->frame[i]) + 1;
+		memcpy(p, m->frame[i], n);
+		p += n;
+	}
+
+	b->len += 2 + len;
+	b->count++;
+	return 0;
+}
+
+struct metric* batch_next(const char *blob, size_t len, size_t *off)
+{
+	const unsigned char *r;
+	const char *p, *end, *f[METRIC_FRAMES] = { 0 };
+	size_t n;
+	int i, nf;
+
+	if (*off + 3 > len)
+		return NULL;
+
+	r  = (const unsigned char *)blob + *off;
+	n  = (r[0] << 8) | r[1];
+	nf = r[2];
+	if (n < 1 || *off + 2 + n > len || nf < 1 || nf > METRIC_FRAMES)
+		return NULL;
+
+	p   = (const char *)r + 3;
+	end = (const char *)r + 2 + n;
+	for (i = 0; i < nf; i++) {
+		f[i] = p;
+		p = memchr(p, '\0', end - p);
+		if (!p)
+			return NULL;
+		p++;
+	}
+	if (p != end)
+		return NULL;
+
+	*off += 2 + n;
+	return metric_new(nf, f[0], f[1], f[2], f[3], f[4]);
+}
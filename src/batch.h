@@ -0,0 +1,66 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_BATCH_H
+#define TINYBOLO_BATCH_H
+
+#include <stddef.h>
+
+#include "metric.h"
+
+/* In batch mode, instead of sending each metric as its own
+   multipart message, tinybolo packs many of them into one:
+
+     [ "" | "BATCH" | <blob> ]
+
+   where the blob is a run of records, each one being
+
+     <length:16, big-endian> <frames:8> <frame>\0 <frame>\0 ...
+
+   and the length counts everything after itself.  bolo does
+   not (yet) understand batches; tinyrelay sits in front of it
+   and unpacks them back into individual metrics. */
+#define BATCH_FRAME "BATCH"
+
+/* the largest batch tinybolo will build (-B), and so the largest
+   (decompressed) batch tinyrelay will accept off the wire */
+#define BATCH_MAX (16 * 1024 * 1024)
+
+struct batch {
+	char   *buf;
+	size_t  len;
+	size_t  cap;
+	int     count;
+};
+
+int  batch_init(struct batch *b, size_t cap);
+void batch_reset(struct batch *b);
+
+/* append a metric; returns 0 on success, or 1 if
+   it does not fit (and the batch is unchanged). */
+int batch_add(struct batch *b, const struct metric *m);
+
+/* decode the record at *off in a blob of `len' bytes,
+   and advance *off past it.  returns a newly allocated
+   metric, or NULL at the end of the blob (*off == len)
+   or if the blob is malformed (*off != len). */
+struct metric* batch_next(const char *blob, size_t len, size_t *off);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "capture.h"
+
+/* a record is at most 2 + 0xffff bytes (see batch_add) */
+#define RECORD_MAX (2 + 0xffff)
+
+static struct capture* capture(const char *path, const char *mode)
+{
+	struct capture *c = calloc(1, sizeof(struct capture));
+	if (!c || batch_init(&c->b, RECORD_MAX) != 0) {
+		fprintf(stderr, "out of memory\n");
+		free(c);
+		return NULL;
+	}
+
+	c->io = fopen(path, mode);
+	if (!c->io) {
+		fprintf(stderr, "failed to open capture %s: %s\n", path, strerror(errno));
+		capture_close(c);
+		return NULL;
+	}
+	return c;
+}
+
+struct capture* capture_create(const char *path)
+{
+	struct capture *c = capture(path, "we");
+	if (!c)
+		return NULL;
+
+	if (fwrite(CAPTURE_MAGIC, 8, 1, c->io) != 1) {
+		fprintf(stderr, "failed to write capture %s: %s\n", path, strerror(errno));
+		capture_close(c);
+		return NULL;
+	}
+	fflush(c->io); /* so that a fork() doesn't write it twice */
+	return c;
+}
+
+int capture_write(struct capture *c, int64_t usec, const struct metric *m)
+{
+	unsigned char v[10];
+	uint64_t d = usec > c->last ? usec - c->last : 0;
+	int n = 0;
+
+	batch_reset(&c->b);
+	if (batch_add(&c->b, m) != 0)
+		return 1;
+
+	do {
+		v[n++] = (d & 0x7f) | (d > 0x7f ? 0x80 : 0);
+		d >>= 7;
+	} while (d);
+
+	c->last = usec > c->last ? usec : c->last;
+	if (fwrite(v, n, 1, c->io) != 1
+	 || fwrite(c->b.buf, c->b.len, 1, c->io) != 1)
+		return 1;
+	return 0;
+}
+
+void capture_flush(struct capture *c)
+{
+	fflush(c->io);
+}
+
+struct capture* capture_open(const char *path)
+{
+	char magic[8];
+	struct capture *c = capture(path, "re");
+	if (!c)
+		return NULL;
+
+	if (fread(magic, 8, 1, c->io) != 1 || memcmp(magic, CAPTURE_MAGIC, 8) != 0) {
+		fprintf(stderr, "%s is not a tinybolo capture\n", path);
+		capture_close(c);
+		return NULL;
+	}
+	return c;
+}
+
+struct metric* capture_read(struct capture *c, int64_t *usec)
+{
+	struct metric *m;
+	uint64_t d = 0;
+	size_t len, off = 0;
+	int ch, shift = 0;
+
+	do {
+		if ((ch = getc(c->io)) == EOF) {
+			c->cut = shift != 0;
+			return NULL;
+		}
+		if (shift > 63)
+			goto bad;
+		d |= (uint64_t)(ch & 0x7f) << shift;
+		shift += 7;
+	} while (ch & 0x80);
+
+	if (fread(c->b.buf, 2, 1, c->io) != 1)
+		goto cut;
+	len = ((unsigned char)c->b.buf[0] << 8) | (unsigned char)c->b.buf[1];
+	if (fread(c->b.buf + 2, len, 1, c->io) != 1)
+		goto cut;
+
+	m = batch_next(c->b.buf, 2 + len, &off);
+	if (!m)
+		goto bad;
+
+	c->last += d;
+	*usec = c->last;
+	return m;
+
+cut:
+	if (feof(c->io)) {
+		c->cut = 1;
+		return NULL;
+	}
+bad:
+	c->bad = 1;
+	return NULL;
+}
+
+void capture_close(struct capture *c)
+{
+	if (!c)
+		return;
+	if (c->io)
+		fclose(c->io);
+	free(c->b.buf);
+	free(c);
+}
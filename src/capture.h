@@ -0,0 +1,68 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_CAPTURE_H
+#define TINYBOLO_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "metric.h"
+#include "batch.h"
+
+/* A capture file holds every metric tinybolo sent (-W), along
+   with when it was sent, so that it can be played back later
+   (-P), as load for bolo.  After an 8-byte magic number, each
+   record is
+
+     <microseconds since the last record, as a varint> <metric>
+
+   where the metric is encoded as in a batch (see batch.h), and
+   the first record's time is counted from the epoch. */
+#define CAPTURE_MAGIC "TBCAP001"
+
+struct capture {
+	FILE        *io;
+	int64_t      last;   /* time of the last record (µs) */
+	struct batch b;      /* room for one record          */
+	int          bad;    /* hit a malformed record       */
+	int          cut;    /* the last record is cut short */
+};
+
+/* start a new capture file, replacing whatever was there */
+struct capture* capture_create(const char *path);
+
+/* returns 0 on success, 1 on failure */
+int capture_write(struct capture *c, int64_t usec, const struct metric *m);
+void capture_flush(struct capture *c);
+
+/* open a capture file to be read; complains, and returns
+   NULL, if it can't be read or isn't a capture file. */
+struct capture* capture_open(const char *path);
+
+/* the next metric from a capture (which the caller must free),
+   and when it was sent; NULL at the end, or if it's corrupt
+   (c->bad), or ends part way through a record (c->cut), as it
+   will if tinybolo was killed while recording */
+struct metric* capture_read(struct capture *c, int64_t *usec);
+
+void capture_close(struct capture *c);
+
+#endif
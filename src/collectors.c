@@ -0,0 +1,954 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <fnmatch.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+
+#include "collectors.h"
+#include "procs.h"
+#include "fsstat.h"
+
+#ifndef PROC
+#define PROC "/proc"
+#else
+/* rtnetlink would tell us about this box, not about PROC */
+#define NO_NETLINK
+#endif
+
+/* how long a mount point gets to answer statvfs() */
+#define MOUNT_TIMEOUT_MS 2000
+
+static int32_t ts;
+
+/* the /proc files we read on every run.  each one is opened the
+   first time it's needed, and kept open; after that, it's read
+   from the top with pread(), into a buffer that only ever
+   grows.  in a long-running process (openwrt -i, or tinybolo's
+   builtin:openwrt) that saves an open(), a close() and a round
+   of stdio allocations per file per run. */
+#define F_MEMINFO   0
+#define F_LOADAVG   1
+#define F_STAT      2
+#define F_FILENR    3
+#define F_MOUNTS    4
+#define F_VMSTAT    5
+#define F_DISKSTATS 6
+#define F_NETDEV    7
+static struct {
+	const char *path;
+	int         fd;
+} files[] = {
+	{ PROC "/meminfo",         -1 },
+	{ PROC "/loadavg",         -1 },
+	{ PROC "/stat",            -1 },
+	{ PROC "/sys/fs/file-nr",  -1 },
+	{ PROC "/mounts",          -1 },
+	{ PROC "/vmstat",          -1 },
+	{ PROC "/diskstats",       -1 },
+	{ PROC "/net/dev",         -1 },
+};
+static char  *text    = NULL;
+static size_t textcap = 0;
+
+/* the process directory, likewise kept open for collect_procs() */
+static int procfd = -1;
+
+/* read all of one of the above files into `text', and return
+   it (NUL-terminated), or NULL if it can't be read */
+static char* slurp(int f)
+{
+	ssize_t n;
+	size_t len = 0;
+	char *more;
+
+	if (files[f].fd < 0)
+		files[f].fd = open(files[f].path, O_RDONLY | O_CLOEXEC);
+	if (files[f].fd < 0)
+		return NULL;
+
+	for (;;) {
+		if (textcap - len < 2) {
+			more = realloc(text, textcap ? textcap * 2 : 8192);
+			if (!more)
+				return NULL;
+			text    = more;
+			textcap = textcap ? textcap * 2 : 8192;
+		}
+		n = pread(files[f].fd, text + len, textcap - len - 1, len);
+		if (n < 0) {
+			/* start over with a fresh descriptor next time */
+			close(files[f].fd);
+			files[f].fd = -1;
+			return NULL;
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+	text[len] = '\0';
+	return text;
+}
+
+/* the next line of a slurp()ed file (without its newline),
+   or NULL once they run out */
+static char* line(char **p)
+{
+	char *l = *p, *nl;
+
+	if (!l || !*l)
+		return NULL;
+	nl = strchr(l, '\n');
+	if (nl) {
+		*nl = '\0';
+		*p = nl + 1;
+	} else {
+		*p = NULL;
+	}
+	return l;
+}
+
+static int32_t time_s(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec;
+}
+
+#define streq(a,b) (strcmp((a), (b)) == 0)
+
+static void vemit(struct emitter *e, const char *type, int32_t ts, const char *value, const char *fmt, va_list ap)
+{
+	char name[1024];
+	const char *f, *a;
+	size_t n = 0;
+	va_list ap2;
+
+	/* every name we make is a fixed string with %s's in it,
+	   which we can fill in without going through vsnprintf();
+	   anything fancier gets the real thing */
+	va_copy(ap2, ap);
+	for (f = fmt; *f && n < sizeof(name) - 1; f++) {
+		if (*f != '%') {
+			name[n++] = *f;
+			continue;
+		}
+		if (*++f != 's') {
+			vsnprintf(name, sizeof(name), fmt, ap2);
+			va_end(ap2);
+			e->metric(e, type, ts, name, value);
+			return;
+		}
+		for (a = va_arg(ap, const char *); *a && n < sizeof(name) - 1; a++)
+			name[n++] = *a;
+	}
+	name[n] = '\0';
+	va_end(ap2);
+	e->metric(e, type, ts, name, value);
+}
+
+/* emit a metric whose value is a string, as-is */
+static void emits(struct emitter *e, const char *type, int32_t ts, const char *v, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vemit(e, type, ts, v, fmt, ap);
+	va_end(ap);
+}
+
+/* emit a metric whose value is an unsigned integer */
+static void emitu(struct emitter *e, const char *type, int32_t ts, uint64_t v, const char *fmt, ...)
+{
+	char value[32], *p = value + sizeof(value) - 1;
+	va_list ap;
+
+	*p = '\0';
+	do *--p = '0' + v % 10; while ((v /= 10) > 0);
+	va_start(ap, fmt);
+	vemit(e, type, ts, p, fmt, ap);
+	va_end(ap);
+}
+
+/* emit a metric whose value is fractional, to two places */
+static void emitf(struct emitter *e, const char *type, int32_t ts, double v, const char *fmt, ...)
+{
+	char value[64];
+	va_list ap;
+	snprintf(value, sizeof(value), "%0.2f", v);
+	va_start(ap, fmt);
+	vemit(e, type, ts, value, fmt, ap);
+	va_end(ap);
+}
+
+int collect_all(struct emitter *e)
+{
+	int rc = 0;
+
+	rc += collect_meminfo(e);
+	rc += collect_loadavg(e);
+	rc += collect_stat(e);
+	rc += collect_procs(e);
+	rc += collect_openfiles(e);
+	rc += collect_mounts(e);
+	rc += collect_vmstat(e);
+	rc += collect_diskstats(e);
+	rc += collect_netdev(e);
+	return rc;
+}
+
+int collect_meminfo(struct emitter *e)
+{
+	char *io = slurp(F_MEMINFO), *l;
+	if (!io)
+		return 1;
+
+	struct {
+		uint32_t total;
+		uint32_t used;
+		uint32_t free;
+		uint32_t buffers;
+		uint32_t cached;
+		uint32_t slab;
+	} M = { 0 };
+	struct {
+		uint32_t total;
+		uint32_t used;
+		uint32_t free;
+		uint32_t cached;
+	} S = { 0 };
+	uint32_t x;
+	ts = time_s();
+	while ((l = line(&io)) != NULL) {
+		/* MemTotal:        6012404 kB */
+		char *k, *v, *u, *e;
+
+		k = l; v = strchr(k, ':');
+		if (!v || !*v) continue;
+
+		*v++ = '\0';
+		while (isspace(*v)) v++;
+		u = strchr(v, ' ');
+		if (u) {
+			*u++ = '\0';
+		} else {
+			u = strchr(v, '\n');
+			if (u) *u = '\0';
+			u = NULL;
+		}
+
+		x = strtoul(v, &e, 10);
+		if (*e) continue;
+
+		if (u && *u == 'k')
+			x *= 1024;
+
+		     if (streq(k, "MemTotal"))   M.total   = x;
+		else if (streq(k, "MemFree"))    M.free    = x;
+		else if (streq(k, "Buffers"))    M.buffers = x;
+		else if (streq(k, "Cached"))     M.cached  = x;
+		else if (streq(k, "Slab"))       M.slab    = x;
+
+		else if (streq(k, "SwapTotal"))  S.total   = x;
+		else if (streq(k, "SwapFree"))   S.free    = x;
+		else if (streq(k, "SwapCached")) S.cached  = x;
+	}
+
+	M.used = M.total - (M.free + M.buffers + M.cached + M.slab);
+	emitu(e, "SAMPLE", ts, M.total,   "memory:total");
+	emitu(e, "SAMPLE", ts, M.used,    "memory:used");
+	emitu(e, "SAMPLE", ts, M.free,    "memory:free");
+	emitu(e, "SAMPLE", ts, M.buffers, "memory:buffers");
+	emitu(e, "SAMPLE", ts, M.cached,  "memory:cached");
+	emitu(e, "SAMPLE", ts, M.slab,    "memory:slab");
+
+	S.used = S.total - (S.free + S.cached);
+	emitu(e, "SAMPLE", ts, S.total,  "swap:total");
+	emitu(e, "SAMPLE", ts, S.cached, "swap:cached");
+	emitu(e, "SAMPLE", ts, S.used,   "swap:used");
+	emitu(e, "SAMPLE", ts, S.free,   "swap:free");
+	return 0;
+}
+
+int collect_loadavg(struct emitter *e)
+{
+	char *io = slurp(F_LOADAVG);
+	if (!io)
+		return 1;
+
+	double load[3];
+	uint64_t proc[3];
+
+	ts = time_s();
+	int rc = sscanf(io, "%lf %lf %lf %" SCNu64 "/%" SCNu64 " ",
+			&load[0], &load[1], &load[2], &proc[0], &proc[1]);
+	if (rc < 5)
+		return 1;
+
+	if (proc[0])
+		proc[0]--; /* don't count us */
+
+	emitf(e, "SAMPLE", ts, load[0], "load:1min");
+	emitf(e, "SAMPLE", ts, load[1], "load:5min");
+	emitf(e, "SAMPLE", ts, load[2], "load:15min");
+	emitu(e, "SAMPLE", ts, proc[0], "load:runnable");
+	emitu(e, "SAMPLE", ts, proc[1], "load:schedulable");
+	return 0;
+}
+
+/* the fields of /proc/stat's "cpu" line, in order */
+static const char *CPU[] = {
+	"cpu:user", "cpu:nice", "cpu:system", "cpu:idle", "cpu:iowait",
+	"cpu:irq", "cpu:softirq", "cpu:steal", "cpu:guest", "cpu:guest-nice",
+};
+
+int collect_stat(struct emitter *e)
+{
+	char *io = slurp(F_STAT), *l;
+	if (!io)
+		return 1;
+
+	int cpus = 0;
+	size_t i;
+	ts = time_s();
+	while ((l = line(&io)) != NULL) {
+		char *k, *v;
+
+		k = v = l;
+		while (*v && !isspace(*v)) v++;
+		if (*v) *v++ = '\0';
+
+		if (streq(k, "processes"))
+			emits(e, "RATE", ts, v, "ctxt:forks-s");
+		else if (streq(k, "ctxt"))
+			emits(e, "RATE", ts, v, "ctxt:cswch-s");
+		else if (strncmp(k, "cpu", 3) == 0 && isdigit(k[3]))
+			cpus++;
+
+		/* older kernels have fewer fields; stop at the end of
+		   the line, rather than running on into the next one */
+		if (streq(k, "cpu")) {
+			for (i = 0; i < sizeof(CPU) / sizeof(CPU[0]); i++) {
+				while (*v && isspace(*v)) v++;
+				if (!*v)
+					break;
+				k = v; while (*k && !isspace(*k)) k++;
+				if (*k) *k++ = '\0';
+				emits(e, "RATE", ts, v, CPU[i]);
+				v = k;
+			}
+		}
+	}
+	emitu(e, "SAMPLE", ts, cpus, "load:cpus");
+	return 0;
+}
+
+int collect_procs(struct emitter *e)
+{
+	struct procstates P;
+
+	if (procfd < 0)
+		procfd = procs_open(PROC);
+	if (procfd < 0)
+		return 1;
+
+	ts = time_s();
+	if (procs_scan(procfd, &P, 0) != 0) {
+		close(procfd);
+		procfd = -1;
+		return 1;
+	}
+
+	emitu(e, "SAMPLE", ts, P.running,  "procs:running");
+	emitu(e, "SAMPLE", ts, P.sleeping, "procs:sleeping");
+	emitu(e, "SAMPLE", ts, P.blocked,  "procs:blocked");
+	emitu(e, "SAMPLE", ts, P.zombies,  "procs:zombies");
+	emitu(e, "SAMPLE", ts, P.stopped,  "procs:stopped");
+	emitu(e, "SAMPLE", ts, P.paging,   "procs:paging");
+	emitu(e, "SAMPLE", ts, P.unknown,  "procs:unknown");
+	return 0;
+}
+
+int collect_openfiles(struct emitter *e)
+{
+	char *io = slurp(F_FILENR);
+	if (!io)
+		return 1;
+
+	ts = time_s();
+	char *a, *b;
+	a = io;
+	/* used file descriptors */
+	while (*a &&  isspace(*a)) a++; b = a;
+	while (*b && !isspace(*b)) b++; *b++ = '\0';
+	emits(e, "SAMPLE", ts, a, "openfiles:used");
+
+	a = b;
+	/* free file descriptors */
+	while (*a &&  isspace(*a)) a++; b = a;
+	while (*b && !isspace(*b)) b++; *b++ = '\0';
+	emits(e, "SAMPLE", ts, a, "openfiles:free");
+
+	a = b;
+	/* max file descriptors */
+	while (*a &&  isspace(*a)) a++; b = a;
+	while (*b && !isspace(*b)) b++; *b++ = '\0';
+	emits(e, "SAMPLE", ts, a, "openfiles:max");
+
+	return 0;
+}
+
+int collect_mounts(struct emitter *e)
+{
+	static struct fsstat *mnt = NULL;
+	static char **dev = NULL;
+	static int max = 0;
+	void *more;
+	int i, n = 0, hung = 0;
+
+	char *io = slurp(F_MOUNTS), *l;
+	if (!io)
+		return 1;
+
+	char *a, *b, *c;
+	ts = time_s();
+	while ((l = line(&io)) != NULL) {
+		a = b = l;
+		for (b = l; *b && !isspace(*b); b++); if (*b) *b++ = '\0';
+		for (c = b; *c && !isspace(*c); c++); if (*c) *c++ = '\0';
+
+		if (n == max) {
+			if (!(more = realloc(mnt, (max + 64) * sizeof(struct fsstat))))
+				break;
+			mnt = more;
+			if (!(more = realloc(dev, (max + 64) * sizeof(char *))))
+				break;
+			dev = more;
+			max += 64;
+		}
+		dev[n] = a;
+		mnt[n].path = b;
+		n++;
+	}
+
+	fsstat_run(mnt, n, MOUNT_TIMEOUT_MS);
+
+	for (i = 0; i < n; i++) {
+		const char *path = mnt[i].path;
+		struct statvfs *fs = &mnt[i].fs;
+
+		if (mnt[i].status == FSSTAT_HUNG) {
+			emitu(e, "SAMPLE", ts, 1, "df:%s:hung", path);
+			hung++;
+			continue;
+		}
+		if (mnt[i].status != FSSTAT_OK)
+			continue;
+
+		emits(e, "KEY", 0, dev[i], "fs:%s",  path);
+		emits(e, "KEY", 0, path,   "dev:%s", dev[i]);
+
+		emitu(e, "SAMPLE", ts, fs->f_files,                "df:%s:inodes.total", path);
+		emitu(e, "SAMPLE", ts, fs->f_favail,               "df:%s:inodes.free", path);
+		emitu(e, "SAMPLE", ts, fs->f_ffree - fs->f_favail, "df:%s:inodes.rfree", path);
+
+		emitu(e, "SAMPLE", ts, fs->f_frsize *  fs->f_blocks,                "df:%s:bytes.total", path);
+		emitu(e, "SAMPLE", ts, fs->f_frsize *  fs->f_bavail,                "df:%s:bytes.free", path);
+		emitu(e, "SAMPLE", ts, fs->f_frsize * (fs->f_bfree - fs->f_bavail), "df:%s:bytes.rfree", path);
+	}
+	emitu(e, "SAMPLE", ts, hung, "mounts:hung");
+	return 0;
+}
+
+int collect_vmstat(struct emitter *e)
+{
+	char *io = slurp(F_VMSTAT), *l;
+	if (!io)
+		return 1;
+
+	uint64_t pgsteal = 0;
+	uint64_t pgscan_kswapd = 0;
+	uint64_t pgscan_direct = 0;
+	ts = time_s();
+	while ((l = line(&io)) != NULL) {
+		char name[64];
+		uint64_t value;
+		int rc = sscanf(l, "%63s %" SCNu64, name, &value);
+		if (rc < 2)
+			continue;
+
+#define VMSTAT_SIMPLE(x,n,v,t) do { \
+	if (streq((n), #t)) emitu(e, "RATE", ts, (v), "vm:%s", #t); \
+} while (0)
+		VMSTAT_SIMPLE(VM, name, value, pswpin);
+		VMSTAT_SIMPLE(VM, name, value, pswpout);
+		VMSTAT_SIMPLE(VM, name, value, pgpgin);
+		VMSTAT_SIMPLE(VM, name, value, pgpgout);
+		VMSTAT_SIMPLE(VM, name, value, pgfault);
+		VMSTAT_SIMPLE(VM, name, value, pgmajfault);
+		VMSTAT_SIMPLE(VM, name, value, pgfree);
+#undef  VMSTAT_SIMPLE
+
+		if (strncmp(name, "pgsteal_", 8) == 0)        pgsteal       += value;
+		if (strncmp(name, "pgscan_kswapd_", 14) == 0) pgscan_kswapd += value;
+		if (strncmp(name, "pgscan_direct_", 14) == 0) pgscan_direct += value;
+	}
+	emitu(e, "RATE", ts, pgsteal,       "vm:pgsteal");
+	emitu(e, "RATE", ts, pgscan_kswapd, "vm:pgscan.kswapd");
+	emitu(e, "RATE", ts, pgscan_direct, "vm:pgscan.direct");
+	return 0;
+}
+
+/* FIXME: figure out a better way to detect devices */
+#define is_device(dev) (strncmp((dev), "loop", 4) != 0 && strncmp((dev), "ram", 3) != 0)
+
+int collect_diskstats(struct emitter *e)
+{
+	char *io = slurp(F_DISKSTATS), *l;
+	if (!io)
+		return 1;
+
+	uint32_t dev[2];
+	uint64_t rd[4], wr[4];
+	ts = time_s();
+	while ((l = line(&io)) != NULL) {
+		char name[32];
+		int rc = sscanf(l, "%" SCNu32 " %" SCNu32 " %31s"
+				" %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+				" %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+				&dev[0], &dev[1], name,
+				&rd[0], &rd[1], &rd[2], &rd[3],
+				&wr[0], &wr[1], &wr[2], &wr[3]);
+		if (rc != 11)
+			continue;
+		if (!is_device(name))
+			continue;
+
+		emitu(e, "RATE", ts, rd[0],        "diskio:%s:rd-iops", name);
+		emitu(e, "RATE", ts, rd[1],        "diskio:%s:rd-miops", name);
+		emitu(e, "RATE", ts, rd[2],        "diskio:%s:rd-msec", name);
+		emitu(e, "RATE", ts, rd[3 ] * 512, "diskio:%s:rd-bytes", name);
+
+		emitu(e, "RATE", ts, wr[0],       "diskio:%s:wr-iops", name);
+		emitu(e, "RATE", ts, wr[1],       "diskio:%s:wr-miops", name);
+		emitu(e, "RATE", ts, wr[2],       "diskio:%s:wr-msec", name);
+		emitu(e, "RATE", ts, wr[3] * 512, "diskio:%s:wr-bytes", name);
+	}
+	return 0;
+}
+
+/* the counters for one network interface, as /proc/net/dev
+   lays them out (and rolls them up) */
+struct netstats {
+	uint64_t bytes;
+	uint64_t packets;
+	uint64_t errors;
+	uint64_t drops;
+	uint64_t overruns;
+	uint64_t frames;
+	uint64_t compressed;
+	uint64_t collisions;
+	uint64_t multicast;
+	uint64_t carrier;
+};
+
+/* is `name' one of the interfaces the emitter wants?  e->ifaces
+   is a comma-separated list of globs; ones starting with `!'
+   are skipped, and if there are any others, only those are
+   collected. */
+static int wanted(struct emitter *e, const char *name)
+{
+	char pat[64];
+	const char *p, *q;
+	int include = 0, included = 0;
+	size_t n;
+
+	if (!e->ifaces || !*e->ifaces)
+		return 1;
+
+	for (p = e->ifaces; *p; p = *q ? q + 1 : q) {
+		q = strchr(p, ',');
+		if (!q)
+			q = p + strlen(p);
+		n = q - p < (ptrdiff_t)sizeof(pat) ? (size_t)(q - p) : sizeof(pat) - 1;
+		memcpy(pat, p, n);
+		pat[n] = '\0';
+
+		if (pat[0] == '!') {
+			if (fnmatch(pat + 1, name, 0) == 0)
+				return 0;
+		} else if (pat[0]) {
+			include = 1;
+			if (!included && fnmatch(pat, name, 0) == 0)
+				included = 1;
+		}
+	}
+	return !include || included;
+}
+
+static void netdev(struct emitter *e, const char *name, struct netstats *rx, struct netstats *tx)
+{
+	emitu(e, "RATE", ts, rx->bytes,      "net:%s:rx.bytes", name);
+	emitu(e, "RATE", ts, rx->packets,    "net:%s:rx.packets", name);
+	emitu(e, "RATE", ts, rx->errors,     "net:%s:rx.errors", name);
+	emitu(e, "RATE", ts, rx->drops,      "net:%s:rx.drops", name);
+	emitu(e, "RATE", ts, rx->overruns,   "net:%s:rx.overruns", name);
+	emitu(e, "RATE", ts, rx->compressed, "net:%s:rx.compressed", name);
+	emitu(e, "RATE", ts, rx->frames,     "net:%s:rx.frames", name);
+	emitu(e, "RATE", ts, rx->multicast,  "net:%s:rx.multicast", name);
+
+	emitu(e, "RATE", ts, tx->bytes,      "net:%s:tx.bytes", name);
+	emitu(e, "RATE", ts, tx->packets,    "net:%s:tx.packets", name);
+	emitu(e, "RATE", ts, tx->errors,     "net:%s:tx.errors", name);
+	emitu(e, "RATE", ts, tx->drops,      "net:%s:tx.drops", name);
+	emitu(e, "RATE", ts, tx->overruns,   "net:%s:tx.overruns", name);
+	emitu(e, "RATE", ts, tx->compressed, "net:%s:tx.compressed", name);
+	emitu(e, "RATE", ts, tx->collisions, "net:%s:tx.collisions", name);
+	emitu(e, "RATE", ts, tx->carrier,    "net:%s:tx.carrier", name);
+}
+
+/* the rtnetlink socket, kept open like the /proc files are;
+   -1 until it's opened, or -2 if we can't use it at all (no
+   netlink, or a kernel too old for RTM_GETSTATS) */
+#ifdef NO_NETLINK
+static int      nlfd  = -2;
+#else
+static int      nlfd  = -1;
+#endif
+static uint32_t nlseq = 0;
+static union {
+	struct nlmsghdr h;
+	char            buf[64 * 1024];
+} nl;
+
+/* RTM_GETSTATS only gives us interface indexes, so we keep a
+   table of their names, sorted by index.  it's rebuilt from
+   an RTM_GETLINK dump (which is much heavier than the stats
+   dump) only when the socket, which listens for link changes,
+   hears about one. */
+static struct ifname {
+	int  index;
+	int  want;          /* passes wanted() for `wantfor'     */
+	char name[IFNAMSIZ];
+} *ifnames = NULL;
+static size_t nifnames = 0, maxifnames = 0;
+static int    stale   = 1;
+static char  *wantfor = NULL; /* the e->ifaces `want' is for */
+static int    nstats  = 0;    /* interfaces reported this run */
+
+static void netdev_fail(void)
+{
+	close(nlfd);
+	nlfd  = -1;
+	stale = 1;
+}
+
+/* send a dump request, and hand every reply to `each';
+   returns 0, the (positive) errno the kernel sent back, or -1
+   if we couldn't talk to it */
+static int netdev_dump(void *req, size_t len,
+                       void (*each)(struct emitter *, struct nlmsghdr *), struct emitter *e)
+{
+	struct nlmsghdr *h = req;
+	ssize_t n;
+
+	h->nlmsg_len   = len;
+	h->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	h->nlmsg_seq   = ++nlseq;
+	if (send(nlfd, req, len, 0) < 0)
+		return -1;
+
+	for (;;) {
+		n = recv(nlfd, nl.buf, sizeof(nl.buf), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == ENOBUFS) {
+			stale = 1; /* missed some link changes */
+			continue;
+		}
+		if (n <= 0)
+			return -1;
+
+		for (h = &nl.h; NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+			if (h->nlmsg_seq != nlseq) {
+				stale = 1; /* a link change */
+				continue;
+			}
+			if (h->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(h);
+				return err->error ? -err->error : -1;
+			}
+			each(e, h);
+		}
+	}
+}
+
+static int ifname_cmp(const void *a, const void *b)
+{
+	return ((const struct ifname *)a)->index - ((const struct ifname *)b)->index;
+}
+
+static void netdev_link(struct emitter *e, struct nlmsghdr *h)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(h);
+	struct rtattr *rta;
+	struct ifname *more;
+	int len;
+
+	if (h->nlmsg_type != RTM_NEWLINK)
+		return;
+	if (nifnames == maxifnames) {
+		more = realloc(ifnames, (maxifnames + 64) * sizeof(struct ifname));
+		if (!more)
+			return;
+		ifnames = more;
+		maxifnames += 64;
+	}
+
+	len = IFLA_PAYLOAD(h);
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_IFNAME) {
+			ifnames[nifnames].index = ifi->ifi_index;
+			strncpy(ifnames[nifnames].name, RTA_DATA(rta), IFNAMSIZ - 1);
+			ifnames[nifnames].name[IFNAMSIZ - 1] = '\0';
+			ifnames[nifnames].want = wanted(e, ifnames[nifnames].name);
+			nifnames++;
+			return;
+		}
+	}
+}
+
+/* one interface's counters; the sums are the ones the kernel
+   does for /proc/net/dev, so the two agree */
+static void netdev_stats(struct emitter *e, struct nlmsghdr *h)
+{
+	struct if_stats_msg *ism = NLMSG_DATA(h);
+	struct ifname key, *ifn;
+	struct rtattr *rta;
+	struct rtnl_link_stats64 st;
+	struct netstats rx, tx;
+	int len;
+
+	if (h->nlmsg_type != RTM_NEWSTATS)
+		return;
+	key.index = ism->ifindex;
+	ifn = bsearch(&key, ifnames, nifnames, sizeof(struct ifname), ifname_cmp);
+	if (!ifn) {
+		stale = 1; /* new since the last RTM_GETLINK */
+		return;
+	}
+	if (!ifn->want)
+		return;
+
+	len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*ism));
+	rta = (struct rtattr *)((char *)ism + NLMSG_ALIGN(sizeof(*ism)));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+		if (rta->rta_type == IFLA_STATS_LINK_64)
+			break;
+	if (!RTA_OK(rta, len))
+		return;
+
+	/* older kernels send less; newer, more */
+	memset(&st, 0, sizeof(st));
+	memcpy(&st, RTA_DATA(rta), RTA_PAYLOAD(rta) < sizeof(st) ? RTA_PAYLOAD(rta) : sizeof(st));
+
+	memset(&rx, 0, sizeof(rx));
+	rx.bytes      = st.rx_bytes;
+	rx.packets    = st.rx_packets;
+	rx.errors     = st.rx_errors;
+	rx.drops      = st.rx_dropped + st.rx_missed_errors;
+	rx.overruns   = st.rx_fifo_errors;
+	rx.frames     = st.rx_length_errors + st.rx_over_errors
+	              + st.rx_crc_errors    + st.rx_frame_errors;
+	rx.compressed = st.rx_compressed;
+	rx.multicast  = st.multicast;
+
+	memset(&tx, 0, sizeof(tx));
+	tx.bytes      = st.tx_bytes;
+	tx.packets    = st.tx_packets;
+	tx.errors     = st.tx_errors;
+	tx.drops      = st.tx_dropped;
+	tx.overruns   = st.tx_fifo_errors;
+	tx.collisions = st.collisions;
+	tx.carrier    = st.tx_carrier_errors + st.tx_aborted_errors
+	              + st.tx_window_errors  + st.tx_heartbeat_errors;
+	tx.compressed = st.tx_compressed;
+
+	netdev(e, ifn->name, &rx, &tx);
+	nstats++;
+}
+
+/* pull every interface's counters over rtnetlink; returns 0 if
+   that worked, or -1 (having emitted nothing) if it didn't */
+static int netdev_netlink(struct emitter *e)
+{
+	struct {
+		struct nlmsghdr  h;
+		struct ifinfomsg ifi;
+	} links;
+	struct {
+		struct nlmsghdr     h;
+		struct if_stats_msg ism;
+	} stats;
+	struct sockaddr_nl sa;
+	size_t i;
+	int rc;
+
+	if (nlfd == -2)
+		return -1;
+	if (nlfd < 0) {
+		nlfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+		if (nlfd < 0) {
+			nlfd = -2;
+			return -1;
+		}
+		memset(&sa, 0, sizeof(sa));
+		sa.nl_family = AF_NETLINK;
+		sa.nl_groups = RTMGRP_LINK;
+		if (bind(nlfd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+			netdev_fail();
+			nlfd = -2;
+			return -1;
+		}
+		stale = 1;
+	}
+
+	/* anything happen to the links since last time? */
+	while (recv(nlfd, nl.buf, sizeof(nl.buf), MSG_DONTWAIT) > 0 || errno == ENOBUFS)
+		stale = 1;
+
+	if (stale) {
+		stale = 0;
+		nifnames = 0;
+		memset(&links, 0, sizeof(links));
+		links.h.nlmsg_type   = RTM_GETLINK;
+		links.ifi.ifi_family = AF_UNSPEC;
+		if (netdev_dump(&links, sizeof(links), netdev_link, e) != 0) {
+			netdev_fail();
+			return -1;
+		}
+		qsort(ifnames, nifnames, sizeof(struct ifname), ifname_cmp);
+		free(wantfor);
+		wantfor = e->ifaces ? strdup(e->ifaces) : NULL;
+
+	} else if (!wantfor != !e->ifaces || (wantfor && strcmp(wantfor, e->ifaces) != 0)) {
+		for (i = 0; i < nifnames; i++)
+			ifnames[i].want = wanted(e, ifnames[i].name);
+		free(wantfor);
+		wantfor = e->ifaces ? strdup(e->ifaces) : NULL;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	stats.h.nlmsg_type      = RTM_GETSTATS;
+	stats.ism.family        = AF_UNSPEC;
+	stats.ism.filter_mask   = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+	nstats = 0;
+	rc = netdev_dump(&stats, sizeof(stats), netdev_stats, e);
+	if (rc == 0)
+		return 0;
+
+	netdev_fail();
+	if (rc == EOPNOTSUPP || rc == EINVAL)
+		nlfd = -2; /* pre-4.7 kernel; stick to /proc */
+	return nstats ? 0 : -1; /* don't report anything twice */
+}
+
+int collect_netdev(struct emitter *e)
+{
+	ts = time_s();
+	if (netdev_netlink(e) == 0)
+		return 0;
+
+	char *io = slurp(F_NETDEV), *l;
+	if (!io)
+		return 1;
+
+	if (line(&io) == NULL
+	 || line(&io) == NULL)
+		return 1;
+
+	struct netstats rx, tx;
+	while ((l = line(&io)) != NULL) {
+		/*   eth0: 1234 56 0 0 0 0 0 0 7890 12 0 0 0 0 0 0 */
+		char *name, *p;
+		uint64_t v[16];
+		int i;
+
+		for (name = l; isspace(*name); name++);
+		if (!(p = strchr(name, ':')))
+			continue;
+		*p++ = '\0';
+		if (!wanted(e, name))
+			continue;
+
+		for (i = 0; i < 16; i++) {
+			char *end;
+			v[i] = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			p = end;
+		}
+		if (i < 16)
+			continue;
+
+		memset(&rx, 0, sizeof(rx));
+		rx.bytes      = v[0];
+		rx.packets    = v[1];
+		rx.errors     = v[2];
+		rx.drops      = v[3];
+		rx.overruns   = v[4];
+		rx.frames     = v[5];
+		rx.compressed = v[6];
+		rx.multicast  = v[7];
+
+		memset(&tx, 0, sizeof(tx));
+		tx.bytes      = v[8];
+		tx.packets    = v[9];
+		tx.errors     = v[10];
+		tx.drops      = v[11];
+		tx.overruns   = v[12];
+		tx.collisions = v[13];
+		tx.carrier    = v[14];
+		tx.compressed = v[15];
+
+		netdev(e, name, &rx, &tx);
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TINYBOLO_COLLECTORS_H
+#define TINYBOLO_COLLECTORS_H
+
+#include <stdint.h>
+
+/* The collectors don't print anything themselves; every metric
+   they find is handed to an emitter, which decides what to do
+   with it.  The openwrt binary prints them as text, tinybolo's
+   `builtin:openwrt' sends them straight to bolo.
+
+   `name' does not include the prefix; for KEY records, `ts' is
+   meaningless and should be ignored. */
+struct emitter {
+	const char *prefix;
+	void (*metric)(struct emitter *e, const char *type, int32_t ts,
+	               const char *name, const char *value);
+	void *data;
+
+	/* network interfaces to collect: comma-separated globs,
+	   with a `!' in front of ones to skip; NULL for all */
+	const char *ifaces;
+};
+
+int collect_meminfo(struct emitter *e);
+int collect_loadavg(struct emitter *e);
+int collect_stat(struct emitter *e);
+int collect_procs(struct emitter *e);
+int collect_openfiles(struct emitter *e);
+int collect_mounts(struct emitter *e);
+int collect_vmstat(struct emitter *e);
+int collect_diskstats(struct emitter *e);
+int collect_netdev(struct emitter *e);
+
+/* run all of the above; returns how many of them failed */
+int collect_all(struct emitter *e);
+
+#endif
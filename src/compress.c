@@ -0,0 +1,172 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+#define HEADER 4
+
+static const char *NAMES[] = {
+	[COMPRESS_NONE] = "none",
+	[COMPRESS_LZ4]  = "lz4",
+	[COMPRESS_ZSTD] = "zstd",
+};
+static const char *FRAMES[] = {
+	[COMPRESS_NONE] = "BATCH",
+	[COMPRESS_LZ4]  = "BATCH/lz4",
+	[COMPRESS_ZSTD] = "BATCH/zstd",
+};
+
+static int supported(int algo)
+{
+	switch (algo) {
+	case COMPRESS_NONE: return 1;
+#ifdef HAVE_LZ4
+	case COMPRESS_LZ4:  return 1;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD: return 1;
+#endif
+	default:            return 0;
+	}
+}
+
+int compress_algorithm(const char *name)
+{
+	int i;
+	for (i = COMPRESS_NONE; i <= COMPRESS_ZSTD; i++)
+		if (strcmp(name, NAMES[i]) == 0)
+			return supported(i) ? i : -1;
+	return -1;
+}
+
+const char* compress_frame_name(int algo)
+{
+	return FRAMES[algo];
+}
+
+int compress_frame(const char *frame, size_t len)
+{
+	int i;
+	for (i = COMPRESS_LZ4; i <= COMPRESS_ZSTD; i++)
+		if (len == strlen(FRAMES[i]) + 1 && memcmp(frame, FRAMES[i], len) == 0)
+			return supported(i) ? i : -1;
+	return -1;
+}
+
+size_t compress_bound(int algo, size_t len)
+{
+	switch (algo) {
+#ifdef HAVE_LZ4
+	case COMPRESS_LZ4:  return HEADER + LZ4_compressBound(len);
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD: return HEADER + ZSTD_compressBound(len);
+#endif
+	default:            return HEADER + len;
+	}
+}
+
+size_t compress_length(const char *src, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)src;
+	if (len < HEADER)
+		return 0;
+	return ((size_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+size_t compress(int algo, int level, const char *src, size_t len, char *dst, size_t cap)
+{
+	size_t n = 0;
+
+	if (cap <= HEADER)
+		return 0;
+
+	switch (algo) {
+#ifdef HAVE_LZ4
+	case COMPRESS_LZ4: {
+		int rc = level > 1
+		       ? LZ4_compress_HC(src, dst + HEADER, len, cap - HEADER, level)
+		       : LZ4_compress_default(src, dst + HEADER, len, cap - HEADER);
+		n = rc > 0 ? rc : 0;
+		break;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD: {
+		/* keep the context around; setting one up
+		   is more expensive than compressing a batch */
+		static ZSTD_CCtx *ctx = NULL;
+		if (!ctx && !(ctx = ZSTD_createCCtx()))
+			return 0;
+		size_t rc = ZSTD_compressCCtx(ctx, dst + HEADER, cap - HEADER, src, len, level ? level : 3);
+		n = ZSTD_isError(rc) ? 0 : rc;
+		break;
+	}
+#endif
+	default:
+		return 0;
+	}
+
+	if (n == 0 || n + HEADER >= len)
+		return 0;
+
+	dst[0] = (len >> 24) & 0xff;
+	dst[1] = (len >> 16) & 0xff;
+	dst[2] = (len >>  8) & 0xff;
+	dst[3] =  len        & 0xff;
+	return n + HEADER;
+}
+
+size_t decompress(int algo, const char *src, size_t len, char *dst, size_t cap)
+{
+	size_t want = compress_length(src, len);
+	if (!want || want > cap)
+		return 0;
+
+	switch (algo) {
+#ifdef HAVE_LZ4
+	case COMPRESS_LZ4: {
+		int rc = LZ4_decompress_safe(src + HEADER, dst, len - HEADER, want);
+		return rc == (int)want ? want : 0;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESS_ZSTD: {
+		size_t rc = ZSTD_decompress(dst, want, src + HEADER, len - HEADER);
+		return !ZSTD_isError(rc) && rc == want ? want : 0;
+	}
+#endif
+	default:
+		return 0;
+	}
+}
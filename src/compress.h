@@ -0,0 +1,64 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_COMPRESS_H
+#define TINYBOLO_COMPRESS_H
+
+#include <stddef.h>
+
+/* Batches (see batch.h) can be compressed before they go out
+   on the wire, with whichever of LZ4 and zstd were available
+   at build time.  A compressed batch is sent as
+
+     [ "" | "BATCH/<algorithm>" | <length:32, big-endian> <data> ]
+
+   where the length is the size of the uncompressed blob. */
+#define COMPRESS_NONE 0
+#define COMPRESS_LZ4  1
+#define COMPRESS_ZSTD 2
+
+/* look up an algorithm by name ("lz4", "zstd"); returns -1
+   if it is unknown, or tinybolo was built without it. */
+int compress_algorithm(const char *name);
+
+/* the name of the batch frame for a given algorithm, and
+   the reverse; compress_frame() returns -1 if `frame' is
+   not a (supported) compressed batch frame. */
+const char* compress_frame_name(int algo);
+int compress_frame(const char *frame, size_t len);
+
+/* worst-case compressed size of `len' bytes, including
+   the uncompressed length header */
+size_t compress_bound(int algo, size_t len);
+
+/* compress `len' bytes of `src' into `dst', including the
+   length header; returns the size of the result, or 0 if
+   it could not be compressed (or didn't get any smaller). */
+size_t compress(int algo, int level, const char *src, size_t len, char *dst, size_t cap);
+
+/* the uncompressed length of a compressed blob, from its header */
+size_t compress_length(const char *src, size_t len);
+
+/* decompress a blob (header and all) into `dst', which must be
+   at least compress_length() bytes; returns that length, or 0
+   if the data is corrupt. */
+size_t decompress(int algo, const char *src, size_t len, char *dst, size_t cap);
+
+#endif
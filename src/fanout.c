@@ -0,0 +1,211 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <zmq.h>
+
+#include "fanout.h"
+
+int fanout_policy(const char *name)
+{
+	if (strcmp(name, "failover")  == 0) return FANOUT_FAILOVER;
+	if (strcmp(name, "broadcast") == 0) return FANOUT_BROADCAST;
+	if (strcmp(name, "shard")     == 0) return FANOUT_SHARD;
+	return -1;
+}
+
+static int64_t now_ms(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
+}
+
+struct fanout* fanout_new(void *zmq, char **uris, int n, int policy, int spooling)
+{
+	struct fanout *f;
+	int i, one = 1, hwm = FANOUT_HWM;
+
+	f = calloc(1, sizeof(struct fanout));
+	if (!f || !(f->ep = calloc(n, sizeof(struct endpoint)))) {
+		fprintf(stderr, "failed to allocate endpoints: %s\n", strerror(errno));
+		free(f);
+		return NULL;
+	}
+	f->policy = policy;
+	f->n      = n;
+	if (n > 1 && !(f->poll = calloc(n, sizeof(zmq_pollitem_t)))) {
+		fprintf(stderr, "failed to allocate endpoints: %s\n", strerror(errno));
+		free(f->ep);
+		free(f);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		f->ep[i].uri = uris[i];
+		f->ep[i].z   = zmq_socket(zmq, ZMQ_PUSH);
+		if (!f->ep[i].z) {
+			fprintf(stderr, "failed to create a 0MQ socket: %s\n", zmq_strerror(errno));
+			goto fail;
+		}
+		/* with only the one endpoint, and no spool, there is
+		   nowhere else for messages to go, so let 0MQ queue
+		   them up until it's back.  a spool is safer than 0MQ's
+		   memory, though, so keep as little as possible there. */
+		if (n > 1 || spooling)
+			zmq_setsockopt(f->ep[i].z, ZMQ_IMMEDIATE, &one, sizeof(one));
+		if (spooling)
+			zmq_setsockopt(f->ep[i].z, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+		if (zmq_connect(f->ep[i].z, uris[i]) != 0) {
+			fprintf(stderr, "failed to connect to '%s': %s\n", uris[i], zmq_strerror(errno));
+			goto fail;
+		}
+	}
+	return f;
+
+fail:
+	fanout_close(f, 0);
+	return NULL;
+}
+
+void fanout_close(struct fanout *f, int linger)
+{
+	int i;
+
+	if (!f)
+		return;
+	for (i = 0; i < f->n; i++) {
+		if (!f->ep[i].z)
+			continue;
+		zmq_setsockopt(f->ep[i].z, ZMQ_LINGER, &linger, sizeof(linger));
+		zmq_close(f->ep[i].z);
+	}
+	free(f->ep);
+	free(f->poll);
+	free(f);
+}
+
+int fanout_shard(struct fanout *f, const char *key)
+{
+	uint32_t h = 2166136261u;
+
+	if (f->policy != FANOUT_SHARD)
+		return 0;
+	for (; *key; key++)
+		h = (h ^ (unsigned char)*key) * 16777619u;
+	return h % f->n;
+}
+
+/* returns 0 if the endpoint took the message, or 1 if not */
+static int put(struct endpoint *e, struct iovec *msg, int n, int flags)
+{
+	int i, rc = 0;
+
+	for (i = 0; i < n && rc >= 0; i++)
+		rc = zmq_send(e->z, msg[i].iov_base, msg[i].iov_len,
+		              (i == n - 1 ? 0 : ZMQ_SNDMORE) | (i == 0 ? flags : 0));
+
+	if (rc < 0) {
+		if (errno != EAGAIN) {
+			fprintf(stderr, "zmq_send to '%s' failed: %s\n", e->uri, zmq_strerror(errno));
+			__atomic_add_fetch(&e->errors, 1, __ATOMIC_RELAXED);
+		} else {
+			__atomic_add_fetch(&e->eagain, 1, __ATOMIC_RELAXED);
+		}
+		return 1;
+	}
+	__atomic_add_fetch(&e->sent, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* one pass over the endpoints, by the policy, without blocking;
+   with `all', even the ones that are down get a try */
+static int attempt(struct fanout *f, int shard, struct iovec *msg, int n, int all, int *err)
+{
+	struct endpoint *e;
+	int64_t t;
+	int i, ok = 0;
+
+	t = now_ms();
+	for (i = 0; i < f->n; i++) {
+		e = &f->ep[(shard + i) % f->n];
+		if (!all && e->down && t - e->down < FANOUT_RETRY_MS) {
+			__atomic_add_fetch(&e->skipped, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (put(e, msg, n, ZMQ_DONTWAIT) != 0) {
+			if (errno == EAGAIN) {
+				if (!e->down)
+					fprintf(stderr, "bolo endpoint '%s' is down\n", e->uri);
+				__atomic_store_n(&e->down, t, __ATOMIC_RELAXED);
+			} else {
+				*err = errno;
+			}
+			continue;
+		}
+		if (e->down) {
+			fprintf(stderr, "bolo endpoint '%s' is back up\n", e->uri);
+			__atomic_store_n(&e->down, 0, __ATOMIC_RELAXED);
+		}
+		ok = 1;
+		if (f->policy != FANOUT_BROADCAST)
+			break;
+	}
+	return ok;
+}
+
+int fanout_send(struct fanout *f, int shard, struct iovec *msg, int n, int flags)
+{
+	zmq_pollitem_t *p = f->poll;
+	int i, err = EAGAIN;
+
+	if (f->n == 1)
+		return put(&f->ep[0], msg, n, flags);
+
+	if (attempt(f, shard, msg, n, 0, &err))
+		return 0;
+
+	/* nobody could take it; rather than block on any one of
+	   them (which might never come back), wait for whichever
+	   does first, and go through the policy order again */
+	if (!(flags & ZMQ_DONTWAIT)) {
+		for (;;) {
+			for (i = 0; i < f->n; i++) {
+				p[i].socket  = f->ep[i].z;
+				p[i].fd      = -1;
+				p[i].events  = ZMQ_POLLOUT;
+				p[i].revents = 0;
+			}
+			if (zmq_poll(p, f->n, FANOUT_RETRY_MS) < 0 && errno != EINTR)
+				break;
+			if (attempt(f, shard, msg, n, 1, &err))
+				return 0;
+		}
+		err = errno;
+	}
+
+	errno = err;
+	return 1;
+}
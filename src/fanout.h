@@ -0,0 +1,93 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_FANOUT_H
+#define TINYBOLO_FANOUT_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+/* How to spread metrics over more than one bolo endpoint (-e):
+
+     failover  - send everything to the first endpoint that is
+                 up, in the order given (the default)
+     broadcast - send everything to every endpoint
+     shard     - send each metric to one endpoint, picked by a
+                 hash of its name, so that a given series always
+                 ends up at the same aggregator (while it is up)
+
+   An endpoint is taken to be down when it won't take a message
+   right away; each one gets its own PUSH socket, with
+   ZMQ_IMMEDIATE set, so that happens as soon as the connection
+   drops.  Down endpoints are skipped for FANOUT_RETRY_MS, and
+   then tried again, so traffic goes back to them once they
+   recover.
+
+   With a spool (-s), a lone endpoint gets ZMQ_IMMEDIATE too, and
+   every endpoint's send queue is cut down to FANOUT_HWM messages,
+   so that an outage sends metrics to disk (which survives a
+   restart) rather than piling them up in 0MQ. */
+#define FANOUT_FAILOVER  0
+#define FANOUT_BROADCAST 1
+#define FANOUT_SHARD     2
+
+#define FANOUT_RETRY_MS 1000
+#define FANOUT_HWM      16
+
+struct endpoint {
+	char          *uri;
+	void          *z;
+	int64_t        down;    /* when it went down (0 = up) */
+	unsigned long  sent;    /* messages it took           */
+	unsigned long  errors;  /* sends that failed outright */
+	unsigned long  eagain;  /* sends it couldn't take     */
+	unsigned long  skipped; /* messages it missed while down */
+};
+
+struct fanout {
+	int              policy;
+	int              n;
+	struct endpoint *ep;
+	void            *poll;  /* a zmq_pollitem_t per endpoint */
+};
+
+int fanout_policy(const char *name);
+
+/* create a PUSH socket for each of the `n' endpoints, and
+   connect them (set up for `spooling', if there's a spool).
+   complains, and returns NULL, on failure. */
+struct fanout* fanout_new(void *zmq, char **uris, int n, int policy, int spooling);
+/* close the sockets, giving them up to `linger' ms (-1 for
+   as long as it takes) to get anything still queued out */
+void fanout_close(struct fanout *f, int linger);
+
+/* which shard (endpoint) `key' belongs to (0, if not sharding) */
+int fanout_shard(struct fanout *f, const char *key);
+
+/* send the `n' frames in `msg' as one multipart message, to the
+   endpoint(s) chosen by the policy, starting with `shard'.  With
+   ZMQ_DONTWAIT in `flags', never blocks; otherwise, if no
+   endpoint can take the message right now, waits (in rounds of
+   up to FANOUT_RETRY_MS) for any of them to come back, and
+   sends it to the first that does.  Returns 0 if at least one
+   endpoint took it, or 1 (with errno set) if none did. */
+int fanout_send(struct fanout *f, int shard, struct iovec *msg, int n, int flags);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "fsstat.h"
+
+/* how many workers to keep free, and how many to have at
+   most, counting the ones stuck on hung mounts */
+#define WORKERS      4
+#define MAX_WORKERS 16
+
+#define QUEUED  0
+#define RUNNING 1
+#define DONE    2
+
+struct job {
+	struct job     *next;      /* on the queue, or the hung list */
+	char           *path;
+	int             state;
+	int             abandoned; /* we stopped waiting for it      */
+	long long       started;   /* ms, when a worker picked it up */
+	int             status;
+	dev_t           dev;
+	int             claimed;   /* will statvfs() `dev' for all   */
+	int             leader;    /* batch[] index of that job      */
+	struct statvfs  fs;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  done;  /* on CLOCK_MONOTONIC; see setup() */
+static pthread_once_t  once = PTHREAD_ONCE_INIT;
+
+static struct job  *queue = NULL, *tail = NULL;
+static struct job  *hung  = NULL;  /* abandoned, but still running */
+static struct job **batch = NULL;  /* this run's jobs, by index    */
+static int nbatch  = 0;
+static int maxbatch = 0;
+static int pending = 0;            /* of those, not yet finished   */
+static int workers = 0;
+static int stuck   = 0;            /* workers on abandoned jobs    */
+
+static long long now_ms(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return (long long)tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
+}
+
+static void setup(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&done, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/* with the lock held */
+static void finish(struct job *j, int status)
+{
+	struct job **p;
+
+	j->status = status;
+	if (!j->abandoned) {
+		j->state = DONE;
+		pending--;
+		pthread_cond_signal(&done);
+		return;
+	}
+
+	/* nobody is waiting for this one any more */
+	for (p = &hung; *p; p = &(*p)->next) {
+		if (*p == j) {
+			*p = j->next;
+			break;
+		}
+	}
+	free(j->path);
+	free(j);
+	stuck--;
+}
+
+static void* worker(void *unused)
+{
+	struct job *j;
+	struct stat st;
+	int i, rc;
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		/* a stuck worker that came back leaves if there
+		   are enough others to go around */
+		if (workers - stuck > WORKERS)
+			break;
+		if (!queue) {
+			pthread_cond_wait(&work, &lock);
+			continue;
+		}
+
+		j = queue;
+		queue = j->next;
+		if (!queue)
+			tail = NULL;
+		j->state   = RUNNING;
+		j->started = now_ms();
+		pthread_mutex_unlock(&lock);
+
+		rc = lstat(j->path, &st);
+
+		pthread_mutex_lock(&lock);
+		if (rc != 0) {
+			finish(j, FSSTAT_FAILED);
+			continue;
+		}
+		if (!major(st.st_dev)) {
+			finish(j, FSSTAT_VIRTUAL);
+			continue;
+		}
+		if (!j->abandoned) {
+			for (i = 0; i < nbatch; i++) {
+				if (batch[i] && batch[i]->claimed && batch[i]->dev == st.st_dev) {
+					j->leader = i;
+					break;
+				}
+			}
+			if (j->leader >= 0) {
+				finish(j, FSSTAT_OK);
+				continue;
+			}
+			j->claimed = 1;
+			j->dev     = st.st_dev;
+		}
+		pthread_mutex_unlock(&lock);
+
+		rc = statvfs(j->path, &j->fs);
+
+		pthread_mutex_lock(&lock);
+		finish(j, rc == 0 ? FSSTAT_OK : FSSTAT_FAILED);
+	}
+	workers--;
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+/* with the lock held; make sure there are enough free workers */
+static void hire(void)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (workers - stuck < WORKERS && workers < MAX_WORKERS) {
+		if (pthread_create(&tid, &attr, worker, NULL) != 0)
+			break;
+		workers++;
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/* with the lock held; stop waiting for batch[i] */
+static void abandon(int i)
+{
+	struct job *j = batch[i], **p;
+
+	batch[i] = NULL;
+	pending--;
+	if (j->state == QUEUED) {
+		for (p = &queue; *p && *p != j; p = &(*p)->next)
+			;
+		if (*p)
+			*p = j->next;
+		for (tail = queue; tail && tail->next; tail = tail->next)
+			;
+		free(j->path);
+		free(j);
+		return;
+	}
+
+	j->abandoned = 1;
+	j->next = hung;
+	hung = j;
+	stuck++;
+}
+
+void fsstat_run(struct fsstat *f, int n, int ms)
+{
+	struct job *j, **more;
+	long long now, next;
+	int i;
+
+	pthread_once(&once, setup);
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < n; i++)
+		f[i].status = FSSTAT_FAILED;
+	if (n > maxbatch) {
+		more = realloc(batch, n * sizeof(struct job *));
+		if (!more)
+			n = maxbatch;
+		else {
+			batch    = more;
+			maxbatch = n;
+		}
+	}
+
+	nbatch  = n;
+	pending = 0;
+	for (i = 0; i < n; i++) {
+		f[i].status = FSSTAT_HUNG;
+		batch[i] = NULL;
+
+		/* still waiting on it from last time? */
+		for (j = hung; j; j = j->next)
+			if (strcmp(j->path, f[i].path) == 0)
+				break;
+		if (j)
+			continue;
+
+		j = calloc(1, sizeof(struct job));
+		if (!j || !(j->path = strdup(f[i].path))) {
+			free(j);
+			f[i].status = FSSTAT_FAILED;
+			continue;
+		}
+		j->state  = QUEUED;
+		j->leader = -1;
+		if (tail)
+			tail->next = j;
+		else
+			queue = j;
+		tail = j;
+		batch[i] = j;
+		pending++;
+	}
+	hire();
+	pthread_cond_broadcast(&work);
+
+	while (pending > 0) {
+		now  = now_ms();
+		next = now + ms;
+		for (i = 0; i < n; i++) {
+			if (!batch[i] || batch[i]->state != RUNNING)
+				continue;
+			if (batch[i]->started + ms <= now)
+				abandon(i);
+			else if (batch[i]->started + ms < next)
+				next = batch[i]->started + ms;
+		}
+		if (pending == 0)
+			break;
+
+		hire();
+		if (workers == stuck) {
+			/* nobody left to do the rest */
+			for (i = 0; i < n; i++)
+				if (batch[i] && batch[i]->state == QUEUED)
+					abandon(i);
+			break;
+		}
+
+		struct timespec until;
+		until.tv_sec  = next / 1000;
+		until.tv_nsec = next % 1000 * 1000000;
+		pthread_cond_timedwait(&done, &lock, &until);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!(j = batch[i]))
+			continue;
+		if (j->leader >= 0)
+			j = batch[j->leader];
+		if (!j)
+			continue; /* its leader hung */
+		f[i].status = j->status;
+		f[i].fs     = j->fs;
+	}
+	for (i = 0; i < n; i++) {
+		if (batch[i]) {
+			free(batch[i]->path);
+			free(batch[i]);
+			batch[i] = NULL;
+		}
+	}
+	nbatch = 0;
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,53 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_FSSTAT_H
+#define TINYBOLO_FSSTAT_H
+
+#include <sys/statvfs.h>
+
+/* Parallel, deadline-bound lstat() + statvfs() of mount points.
+
+   Paths are handed to a small pool of worker threads (started
+   on first use, and kept).  Each path gets `ms' milliseconds
+   from when a worker picks it up; one that takes longer --
+   a dead NFS server, say -- is given up on and reported as
+   FSSTAT_HUNG, and the worker stuck on it is replaced, so the
+   rest carry on.  Until that call finally returns, later runs
+   report the same path as hung straight away, rather than
+   tying up another worker on it.
+
+   Mount points on the same device (bind mounts, mostly) are
+   only statvfs()'d once per run; the rest share the result. */
+
+#define FSSTAT_OK      0
+#define FSSTAT_FAILED  1 /* lstat() or statvfs() failed      */
+#define FSSTAT_VIRTUAL 2 /* no backing device (major 0)      */
+#define FSSTAT_HUNG    3 /* didn't come back in time         */
+
+struct fsstat {
+	const char     *path;
+	int             status;
+	struct statvfs  fs;
+};
+
+void fsstat_run(struct fsstat *f, int n, int ms);
+
+#endif
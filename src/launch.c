@@ -0,0 +1,134 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+
+#include "launch.h"
+
+extern char **environ;
+
+/* anything that means something to the shell */
+#define SHELL_CHARS "|&;<>()$`\\\"'*?[]#~=%{}!\n"
+
+/* one block: the pointer array, then the strings it points to */
+static char** block(size_t n, size_t len, char **strings)
+{
+	char **argv = malloc((n + 1) * sizeof(char *) + len);
+	if (!argv)
+		return NULL;
+	*strings = (char *)(argv + n + 1);
+	return argv;
+}
+
+char** launch_argv(const char *cmd)
+{
+	char **argv, *s;
+	size_t n, i;
+	const char *a, *b;
+
+	if (strpbrk(cmd, SHELL_CHARS))
+		return NULL;
+
+	for (n = 0, a = cmd; *a; ) {
+		while (*a == ' ' || *a == '\t') a++;
+		if (!*a) break;
+		while (*a && *a != ' ' && *a != '\t') a++;
+		n++;
+	}
+	if (!n)
+		return NULL;
+
+	argv = block(n, strlen(cmd) + 1, &s);
+	if (!argv)
+		return NULL;
+
+	for (i = 0, a = cmd; i < n; i++) {
+		while (*a == ' ' || *a == '\t') a++;
+		for (b = a; *b && *b != ' ' && *b != '\t'; b++);
+		memcpy(s, a, b - a);
+		s[b - a] = '\0';
+		argv[i] = s;
+		s += b - a + 1;
+		a = b;
+	}
+	argv[n] = NULL;
+	return argv;
+}
+
+char** launch_shell(const char *cmd)
+{
+	char **argv, *s;
+	size_t len = strlen(cmd) + 1;
+
+	argv = block(3, sizeof("/bin/sh") + sizeof("-c") + len, &s);
+	if (!argv)
+		return NULL;
+
+	argv[0] = strcpy(s, "/bin/sh"); s += sizeof("/bin/sh");
+	argv[1] = strcpy(s, "-c");      s += sizeof("-c");
+	argv[2] = memcpy(s, cmd, len);
+	argv[3] = NULL;
+	return argv;
+}
+
+pid_t launch(char *const argv[], int in, int out, int err)
+{
+	static posix_spawnattr_t attr;
+	static int ready = 0;
+	posix_spawn_file_actions_t fa;
+	sigset_t none, dfl;
+	pid_t pid;
+	int rc;
+
+	/* the attributes are the same every time */
+	if (!ready) {
+		sigemptyset(&none);
+		sigemptyset(&dfl);
+		sigaddset(&dfl, SIGCHLD);
+		sigaddset(&dfl, SIGHUP);
+		sigaddset(&dfl, SIGPIPE);
+
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setpgroup(&attr, 0);
+		posix_spawnattr_setsigmask(&attr, &none);
+		posix_spawnattr_setsigdefault(&attr, &dfl);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+		                              | POSIX_SPAWN_SETSIGMASK
+		                              | POSIX_SPAWN_SETSIGDEF);
+		ready = 1;
+	}
+
+	posix_spawn_file_actions_init(&fa);
+	if (in  >= 0) posix_spawn_file_actions_adddup2(&fa, in,  0);
+	if (out >= 0) posix_spawn_file_actions_adddup2(&fa, out, 1);
+	if (err >= 0) posix_spawn_file_actions_adddup2(&fa, err, 2);
+
+	rc = posix_spawnp(&pid, argv[0], &fa, &attr, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if (rc != 0) {
+		errno = rc;
+		return -1;
+	}
+	return pid;
+}
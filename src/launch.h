@@ -0,0 +1,47 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_LAUNCH_H
+#define TINYBOLO_LAUNCH_H
+
+#include <sys/types.h>
+
+/* Split a command line into an argv, if it is simple enough
+   to run without a shell: words separated by whitespace, with
+   no quoting, globbing, redirection, variables or the like.
+   Returns NULL if it needs /bin/sh (or we are out of memory).
+   The argv is a single allocation; free() it when done. */
+char** launch_argv(const char *cmd);
+
+/* The argv for running `cmd' through /bin/sh -c; also a single
+   allocation, and NULL only if we are out of memory. */
+char** launch_shell(const char *cmd);
+
+/* Start argv[0] (searching $PATH), in a new process group, with
+   stdin, stdout and stderr connected to `in', `out' and `err'
+   (or left alone if -1).  Uses posix_spawn(), which on Linux
+   (glibc and musl) is a vfork-style clone, so the cost doesn't
+   grow with our RSS the way fork() does.
+
+   Returns the child's pid, or -1 (with errno set) if it could
+   not be started, including if the exec itself failed. */
+pid_t launch(char *const argv[], int in, int out, int err);
+
+#endif
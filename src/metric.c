@@ -0,0 +1,64 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "metric.h"
+
+struct metric* metric_newv(int n, va_list ap)
+{
+	struct metric *m;
+	const char *s[METRIC_FRAMES];
+	size_t len[METRIC_FRAMES], total = 0;
+	int i;
+
+	if (n < 1 || n > METRIC_FRAMES)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		s[i] = va_arg(ap, const char *);
+		len[i] = strlen(s[i]) + 1;
+		total += len[i];
+	}
+
+	m = malloc(sizeof(struct metric) + total);
+	if (!m)
+		return NULL;
+
+	m->n = n;
+	for (i = 0, total = 0; i < n; i++) {
+		m->frame[i] = m->data + total;
+		memcpy(m->frame[i], s[i], len[i]);
+		total += len[i];
+	}
+	return m;
+}
+
+struct metric* metric_new(int n, ...)
+{
+	struct metric *m;
+	va_list ap;
+
+	va_start(ap, n);
+	m = metric_newv(n, ap);
+	va_end(ap);
+	return m;
+}
@@ -0,0 +1,40 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_METRIC_H
+#define TINYBOLO_METRIC_H
+
+#include <stdarg.h>
+
+/* A metric, ready to go out on the wire as a set of frames
+   (not counting the empty envelope frame).  Everything lives
+   in a single allocation, so that metrics can be handed from
+   thread to thread and freed with a single free(). */
+#define METRIC_FRAMES 5
+struct metric {
+	int   n;
+	char *frame[METRIC_FRAMES];
+	char  data[];
+};
+
+struct metric* metric_new(int n, ...);
+struct metric* metric_newv(int n, va_list ap);
+
+#endif
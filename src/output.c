@@ -0,0 +1,127 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "output.h"
+
+#define OUTPUT_BUFSIZ (64 * 1024)
+
+void output_init(struct output *o, int fd)
+{
+	memset(o, 0, sizeof(*o));
+	o->fd = fd;
+}
+
+int output_flush(struct output *o)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	while (off < o->len && !o->failed) {
+		n = write(o->fd, o->buf + off, o->len - off);
+		o->writes++;
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			o->failed = 1;
+		else
+			off += n;
+	}
+	o->len = 0;
+	return o->failed ? -1 : 0;
+}
+
+/* make room for `n' more bytes, flushing (or growing, for a
+   single line that's bigger than the whole buffer) as needed */
+static int room(struct output *o, size_t n)
+{
+	char *more;
+
+	if (o->cap - o->len >= n)
+		return 0;
+	if (o->len)
+		output_flush(o);
+	if (o->cap >= n)
+		return 0;
+
+	more = realloc(o->buf, n > OUTPUT_BUFSIZ ? n : OUTPUT_BUFSIZ);
+	if (!more)
+		return -1;
+	o->buf = more;
+	o->cap = n > OUTPUT_BUFSIZ ? n : OUTPUT_BUFSIZ;
+	return 0;
+}
+
+void output_metric(struct emitter *e, const char *type, int32_t ts,
+                   const char *name, const char *value)
+{
+	struct output *o = e->data;
+	size_t ltype, lname, lvalue, lprefix, lts = 0;
+	char *p, tsbuf[16];
+	int key = strcmp(type, "KEY") == 0;
+
+	if (!key && (ts != o->ts || e->prefix != o->prefix || !o->headlen)) {
+		int n = snprintf(o->head, sizeof(o->head), " %i %s:", ts, e->prefix);
+		o->headlen = n > 0 && (size_t)n < sizeof(o->head) ? (size_t)n : 0;
+		o->ts      = ts;
+		o->prefix  = e->prefix;
+	}
+
+	ltype   = strlen(type);
+	lname   = strlen(name);
+	lvalue  = strlen(value);
+	if (key) {
+		lprefix = strlen(e->prefix) + 2;
+	} else if (o->headlen) {
+		lprefix = o->headlen;
+	} else {
+		/* a prefix too long for head[]; write it out in full */
+		lts     = snprintf(tsbuf, sizeof(tsbuf), "%i", ts);
+		lprefix = 1 + lts + 1 + strlen(e->prefix) + 1;
+	}
+	if (room(o, ltype + lprefix + lname + 1 + lvalue + 1) != 0)
+		return;
+
+	p = o->buf + o->len;
+	memcpy(p, type, ltype); p += ltype;
+	if (key) {
+		*p++ = ' ';
+		memcpy(p, e->prefix, lprefix - 2); p += lprefix - 2;
+		*p++ = ':';
+	} else if (o->headlen) {
+		memcpy(p, o->head, lprefix); p += lprefix;
+	} else {
+		*p++ = ' ';
+		memcpy(p, tsbuf, lts); p += lts;
+		*p++ = ' ';
+		memcpy(p, e->prefix, lprefix - lts - 3); p += lprefix - lts - 3;
+		*p++ = ':';
+	}
+	memcpy(p, name, lname); p += lname;
+	*p++ = ' ';
+	memcpy(p, value, lvalue); p += lvalue;
+	*p++ = '\n';
+	o->len = p - o->buf;
+}
@@ -0,0 +1,60 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_OUTPUT_H
+#define TINYBOLO_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collectors.h"
+
+/* A buffered writer for the openwrt collector's text output.
+
+   Lines are appended to one large buffer and written out with
+   a single write() per output_flush() (or whenever the buffer
+   fills up).  The " TS PREFIX:" that every line of a collector
+   run shares is rendered once, whenever the timestamp changes,
+   rather than for every line (unless the prefix is too long for
+   head[], in which case it is written out in full each time). */
+struct output {
+	int            fd;
+	char          *buf;
+	size_t         len;
+	size_t         cap;
+	int32_t        ts;        /* what head[] was rendered for */
+	const char    *prefix;
+	char           head[256];
+	size_t         headlen;
+	int            failed;    /* a write() failed             */
+	unsigned long  writes;    /* write() calls, all told      */
+};
+
+void output_init(struct output *o, int fd);
+
+/* an emitter callback; `e->data' must point to the output */
+void output_metric(struct emitter *e, const char *type, int32_t ts,
+                   const char *name, const char *value);
+
+/* write out everything buffered so far; returns 0, or -1 if
+   the output (now, or earlier) couldn't be written */
+int output_flush(struct output *o);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "procs.h"
+
+/* how many processes to hand each worker thread, at least,
+   and how many workers to use, at most */
+#define PER_THREAD  4096
+#define MAX_THREADS 8
+
+/* what getdents64() fills its buffer with */
+struct linux_dirent64 {
+	uint64_t       d_ino;
+	int64_t        d_off;
+	unsigned short d_reclen;
+	unsigned char  d_type;
+	char           d_name[];
+};
+
+/* the PIDs found by the last listing; reused from scan to scan */
+static int    *pids   = NULL;
+static size_t  npids  = 0;
+static size_t  maxpid = 0;
+
+struct slice {
+	int               dirfd;
+	int              *pid;
+	size_t            n;
+	struct procstates P;
+};
+
+int procs_open(const char *root)
+{
+	return open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/* list the numeric entries of `dirfd' into pids[] */
+static int list(int dirfd)
+{
+	char buf[64 * 1024];
+	long n, off;
+	int *more;
+
+	npids = 0;
+	if (lseek(dirfd, 0, SEEK_SET) < 0)
+		return -1;
+
+	while ((n = syscall(SYS_getdents64, dirfd, buf, sizeof(buf))) > 0) {
+		for (off = 0; off < n; ) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+			const char *c;
+			int pid = 0;
+
+			off += d->d_reclen;
+			if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+				continue;
+			for (c = d->d_name; *c >= '0' && *c <= '9'; c++)
+				pid = pid * 10 + (*c - '0');
+			if (*c || pid < 1)
+				continue;
+
+			if (npids == maxpid) {
+				more = realloc(pids, (maxpid ? maxpid * 2 : 1024) * sizeof(int));
+				if (!more)
+					return -1;
+				pids   = more;
+				maxpid = maxpid ? maxpid * 2 : 1024;
+			}
+			pids[npids++] = pid;
+		}
+	}
+	return n < 0 ? -1 : 0;
+}
+
+/* read the state of one process, as the letter after its name */
+static char state(int dirfd, int pid)
+{
+	char path[32], buf[256], *p;
+	ssize_t n;
+	int fd, i;
+
+	/* "PID/stat", without going through snprintf() */
+	p = path + 16;
+	do *--p = '0' + pid % 10; while ((pid /= 10) > 0);
+	i = path + 16 - p;
+	memmove(path, p, i);
+	memcpy(path + i, "/stat", 6);
+
+	fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	n = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (n <= 0)
+		return 0;
+
+	/* 1234 (some (odd) name) S 1 ... */
+	for (i = n - 1; i >= 0 && buf[i] != ')'; i--)
+		;
+	if (i < 0 || i + 2 >= n || buf[i + 1] != ' ')
+		return '?';
+	return buf[i + 2];
+}
+
+static void* tally(void *arg)
+{
+	struct slice *s = arg;
+	size_t i;
+
+	for (i = 0; i < s->n; i++) {
+		switch (state(s->dirfd, s->pid[i])) {
+		case 0:   break; /* gone since we listed it */
+		case 'R': s->P.running++;  break;
+		case 'S': s->P.sleeping++; break;
+		case 'D': s->P.blocked++;  break;
+		case 'Z': s->P.zombies++;  break;
+		case 'T': s->P.stopped++;  break;
+		case 'W': s->P.paging++;   break;
+		default:  s->P.unknown++;  break;
+		}
+	}
+	return NULL;
+}
+
+int procs_scan(int dirfd, struct procstates *P, int threads)
+{
+	struct slice s[MAX_THREADS];
+	pthread_t tid[MAX_THREADS];
+	int i, started[MAX_THREADS];
+
+	if (list(dirfd) != 0)
+		return -1;
+
+	if (threads <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = npids / PER_THREAD;
+		if (threads > cpus)
+			threads = cpus;
+	}
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	if (threads < 1 || (size_t)threads > npids)
+		threads = 1;
+
+	for (i = 0; i < threads; i++) {
+		memset(&s[i], 0, sizeof(s[i]));
+		s[i].dirfd = dirfd;
+		s[i].pid   = pids + npids * i / threads;
+		s[i].n     = npids * (i + 1) / threads - npids * i / threads;
+	}
+
+	/* the first slice is ours; if a thread won't start, we do
+	   its slice ourselves, too */
+	for (i = 1; i < threads; i++)
+		started[i] = pthread_create(&tid[i], NULL, tally, &s[i]) == 0;
+	tally(&s[0]);
+	for (i = 1; i < threads; i++) {
+		if (started[i])
+			pthread_join(tid[i], NULL);
+		else
+			tally(&s[i]);
+	}
+
+	memset(P, 0, sizeof(*P));
+	for (i = 0; i < threads; i++) {
+		P->running  += s[i].P.running;
+		P->sleeping += s[i].P.sleeping;
+		P->zombies  += s[i].P.zombies;
+		P->stopped  += s[i].P.stopped;
+		P->paging   += s[i].P.paging;
+		P->blocked  += s[i].P.blocked;
+		P->unknown  += s[i].P.unknown;
+	}
+	return 0;
+}
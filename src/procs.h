@@ -0,0 +1,58 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_PROCS_H
+#define TINYBOLO_PROCS_H
+
+#include <stdint.h>
+
+/* A scanner for the state of every process on the box.
+
+   The process directory is opened once, and listed with
+   getdents64() into a large buffer; each /proc/PID/stat is
+   opened relative to it with openat(), and only its first
+   few hundred bytes are read -- enough to get past the
+   process name (which is found by the *last* `)', since the
+   name itself may hold spaces and parentheses) to the state
+   letter.
+
+   With a lot of processes, the stat files are split across
+   a few worker threads. */
+struct procstates {
+	uint32_t running;
+	uint32_t sleeping;
+	uint32_t zombies;
+	uint32_t stopped;
+	uint32_t paging;
+	uint32_t blocked;
+	uint32_t unknown;
+};
+
+/* open a process directory (normally /proc) for procs_scan();
+   returns the descriptor, or -1 */
+int procs_open(const char *root);
+
+/* tally up the state of every process under `dirfd', using
+   at most `threads' threads (0 picks a number based on how
+   many processes and CPUs there are).  Returns 0 on success,
+   or -1 if the directory couldn't be listed. */
+int procs_scan(int dirfd, struct procstates *P, int threads);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define load(x)    __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define store(x,v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#define cas(x,o,n) __atomic_compare_exchange_n(&(x), &(o), (n), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+
+struct queue* queue_new(unsigned long size, int policy)
+{
+	struct queue *q;
+	unsigned long n;
+
+	for (n = 1; n < size; n <<= 1);
+
+	q = calloc(1, sizeof(struct queue));
+	if (!q)
+		return NULL;
+
+	q->slots = calloc(n, sizeof(struct metric *));
+	if (!q->slots) {
+		free(q);
+		return NULL;
+	}
+
+	q->mask   = n - 1;
+	q->size   = size;
+	q->policy = policy;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->ready, NULL);
+	pthread_cond_init(&q->room, NULL);
+	return q;
+}
+
+int queue_policy(const char *name)
+{
+	if (strcmp(name, "drop-oldest") == 0) return QUEUE_DROP_OLDEST;
+	if (strcmp(name, "drop-newest") == 0) return QUEUE_DROP_NEWEST;
+	if (strcmp(name, "block")       == 0) return QUEUE_BLOCK;
+	return -1;
+}
+
+static void deadline(struct timespec *ts, int ms)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec  += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+int queue_push(struct queue *q, struct metric *m)
+{
+	unsigned long head, tail;
+	struct timespec ts;
+	int rc = 0;
+
+	head = q->head; /* we are the only writer */
+	for (;;) {
+		tail = load(q->tail);
+		if (head - tail < q->size)
+			break;
+
+		if (q->policy == QUEUE_DROP_NEWEST) {
+			free(m);
+			store(q->dropped, q->dropped + 1);
+			return 1;
+		}
+
+		if (q->policy == QUEUE_DROP_OLDEST) {
+			struct metric *old = load(q->slots[tail & q->mask]);
+			if (cas(q->tail, tail, tail + 1)) {
+				free(old);
+				store(q->dropped, q->dropped + 1);
+				rc = 1;
+			}
+			continue;
+		}
+
+		/* QUEUE_BLOCK */
+		pthread_mutex_lock(&q->lock);
+		store(q->waiting, 1);
+		if (head - load(q->tail) >= q->size) {
+			deadline(&ts, 1000);
+			pthread_cond_timedwait(&q->room, &q->lock, &ts);
+		}
+		store(q->waiting, 0);
+		pthread_mutex_unlock(&q->lock);
+	}
+
+	store(q->slots[head & q->mask], m);
+	store(q->head, head + 1);
+
+	if (load(q->sleeping)) {
+		pthread_mutex_lock(&q->lock);
+		pthread_cond_signal(&q->ready);
+		pthread_mutex_unlock(&q->lock);
+	}
+	return rc;
+}
+
+struct metric* queue_pop(struct queue *q, int ms)
+{
+	unsigned long tail;
+	struct metric *m;
+	struct timespec ts;
+	int waited = 0;
+
+	for (;;) {
+		tail = load(q->tail);
+		if (tail != load(q->head)) {
+			m = load(q->slots[tail & q->mask]);
+			if (!cas(q->tail, tail, tail + 1))
+				continue; /* the producer dropped it out from under us */
+
+			if (load(q->waiting)) {
+				pthread_mutex_lock(&q->lock);
+				pthread_cond_signal(&q->room);
+				pthread_mutex_unlock(&q->lock);
+			}
+			return m;
+		}
+
+		if (waited || ms <= 0)
+			return NULL;
+
+		pthread_mutex_lock(&q->lock);
+		store(q->sleeping, 1);
+		if (load(q->tail) == load(q->head)) {
+			deadline(&ts, ms);
+			pthread_cond_timedwait(&q->ready, &q->lock, &ts);
+		}
+		store(q->sleeping, 0);
+		pthread_mutex_unlock(&q->lock);
+		waited = 1;
+	}
+}
+
+void queue_wake(struct queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	pthread_cond_signal(&q->ready);
+	pthread_mutex_unlock(&q->lock);
+}
+
+unsigned long queue_depth(struct queue *q)
+{
+	return load(q->head) - load(q->tail);
+}
+
+unsigned long queue_dropped(struct queue *q)
+{
+	return load(q->dropped);
+}
@@ -0,0 +1,85 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_QUEUE_H
+#define TINYBOLO_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "metric.h"
+
+/* What to do when the queue is full: throw away the oldest
+   queued metric, throw away the one being pushed, or wait
+   for the consumer to make some room. */
+#define QUEUE_DROP_OLDEST 0
+#define QUEUE_DROP_NEWEST 1
+#define QUEUE_BLOCK       2
+
+/* A bounded, single-producer / single-consumer ring buffer.
+   head and tail only ever increase, and are reduced modulo
+   the number of slots (`size', rounded up to a power of two)
+   to find one, but the queue is full at exactly `size'.  The
+   producer owns head; tail is advanced with compare-and-swap,
+   since under QUEUE_DROP_OLDEST the producer may advance it.
+
+   The mutex and condition variables are only used to put an
+   idle consumer (or, under QUEUE_BLOCK, a producer facing a
+   full queue) to sleep; pushes and pops never take it. */
+struct queue {
+	unsigned long   head;
+	unsigned long   tail;
+	unsigned long   mask;
+	unsigned long   size;
+	int             policy;
+	unsigned long   dropped;
+
+	int             sleeping; /* consumer is waiting on `ready' */
+	int             waiting;  /* producer is waiting on `room'  */
+	pthread_mutex_t lock;
+	pthread_cond_t  ready;
+	pthread_cond_t  room;
+
+	struct metric **slots;
+};
+
+struct queue* queue_new(unsigned long size, int policy);
+int queue_policy(const char *name);
+
+/* push a metric onto the queue, which takes ownership of it;
+   returns 0 if it was queued, or 1 if something was dropped. */
+int queue_push(struct queue *q, struct metric *m);
+
+/* pop the oldest metric off of the queue, waiting up to
+   `ms' milliseconds for one to show up; returns NULL if
+   nothing did.  The caller owns (and must free) it. */
+struct metric* queue_pop(struct queue *q, int ms);
+
+/* wake up a consumer sleeping in queue_pop(), so that it can
+   notice something other than a new metric (i.e. shutdown).
+   One that is just about to go to sleep will miss this, and
+   sleep out its timeout. */
+void queue_wake(struct queue *q);
+
+unsigned long queue_depth(struct queue *q);
+unsigned long queue_dropped(struct queue *q);
+
+#endif
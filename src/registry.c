@@ -0,0 +1,146 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "registry.h"
+
+struct collector* collector_new(const char *line)
+{
+	struct collector *c = calloc(1, sizeof(struct collector));
+	if (!c)
+		return NULL;
+
+	c->line = strdup(line);
+	if (!c->line) {
+		free(c);
+		return NULL;
+	}
+	c->cmd = c->line;
+	return c;
+}
+
+void collector_free(struct collector *c)
+{
+	if (!c)
+		return;
+	free(c->line);
+	free(c->argv);
+	free(c->prefix);
+	free(c->ifaces);
+	free(c);
+}
+
+struct registry* registry_new(void)
+{
+	return calloc(1, sizeof(struct registry));
+}
+
+void registry_free(struct registry *r)
+{
+	if (!r)
+		return;
+	free(r->all);
+	free(r->heap);
+	free(r);
+}
+
+int registry_add(struct registry *r, struct collector *c)
+{
+	if (r->n == r->cap) {
+		size_t cap = r->cap ? r->cap * 2 : 64;
+		struct collector **all, **heap;
+
+		all = realloc(r->all, cap * sizeof(struct collector *));
+		if (!all)
+			return 1;
+		r->all = all;
+
+		heap = realloc(r->heap, cap * sizeof(struct collector *));
+		if (!heap)
+			return 1;
+		r->heap = heap;
+		r->cap  = cap;
+	}
+	r->all[r->n++] = c;
+	return 0;
+}
+
+static void swap(struct registry *r, size_t i, size_t j)
+{
+	struct collector *c = r->heap[i];
+	r->heap[i] = r->heap[j];
+	r->heap[j] = c;
+	r->heap[i]->slot = i;
+	r->heap[j]->slot = j;
+}
+
+static void up(struct registry *r, size_t i)
+{
+	while (i > 0 && r->heap[i]->next < r->heap[(i - 1) / 2]->next) {
+		swap(r, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void down(struct registry *r, size_t i)
+{
+	size_t l, least;
+
+	for (;;) {
+		least = i;
+		l = 2 * i + 1;
+		if (l < r->nheap && r->heap[l]->next < r->heap[least]->next)
+			least = l;
+		if (l + 1 < r->nheap && r->heap[l + 1]->next < r->heap[least]->next)
+			least = l + 1;
+		if (least == i)
+			return;
+		swap(r, i, least);
+		i = least;
+	}
+}
+
+void registry_schedule(struct registry *r, struct collector *c)
+{
+	c->slot = r->nheap;
+	r->heap[r->nheap++] = c;
+	up(r, c->slot);
+}
+
+struct collector* registry_due(struct registry *r, int64_t t)
+{
+	struct collector *c;
+
+	if (!r->nheap || r->heap[0]->next > t)
+		return NULL;
+
+	c = r->heap[0];
+	r->heap[0] = r->heap[--r->nheap];
+	r->heap[0]->slot = 0;
+	down(r, 0);
+	return c;
+}
+
+int64_t registry_next(struct registry *r)
+{
+	return r->nheap ? r->heap[0]->next : -1;
+}
@@ -0,0 +1,93 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_REGISTRY_H
+#define TINYBOLO_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COLLECTOR_EXEC    0 /* run every interval, spawned (launch.h) */
+#define COLLECTOR_STREAM  1 /* started once, and kept running         */
+#define COLLECTOR_BUILTIN 2 /* run every interval, in-process         */
+
+/* One configured collector: what it runs, how (and how often)
+   to run it, and how that has been going so far. */
+struct collector {
+	char       *line;      /* config line, verbatim               */
+	const char *cmd;       /* the command proper, within `line'   */
+	char      **argv;      /* what to exec (see launch.h)         */
+	char        name[64];  /* for our own metrics (see name=)     */
+	char       *prefix;    /* prepended to metric names, or NULL  */
+	int         type;      /* COLLECTOR_EXEC, _STREAM or _BUILTIN */
+	int         interval;  /* milliseconds between runs           */
+	int         timeout;   /* seconds before we kill it (0=never) */
+	int         rates;     /* work out rates ourselves (rates=)   */
+	int         rollup;    /* SAMPLE rollup window, ms (rollup=)  */
+	int         dedup;     /* resend unchanged values every N (dedup=) */
+	char       *ifaces;    /* network interfaces, for builtins (ifaces=) */
+	void       *data;      /* for builtins, the implementation    */
+
+	int64_t     next;      /* when it is next due (monotonic ms)  */
+	int         busy;      /* running, or waiting for a job slot  */
+	int         retired;   /* gone from the config; free when idle */
+	size_t      slot;      /* where it is in the schedule heap    */
+
+	unsigned long runs, overruns, timeouts, failures;
+	long        wall, cpu; /* of the last run, in milliseconds    */
+};
+
+struct collector* collector_new(const char *line);
+void collector_free(struct collector *c);
+
+/* All of the configured collectors, in the order they were
+   configured, and a binary min-heap of the ones that run on
+   a schedule, ordered by when they are next due; finding
+   (and rescheduling) due collectors costs O(log n) apiece,
+   not a walk over all of them. */
+struct registry {
+	struct collector **all;
+	size_t             n, cap;
+
+	struct collector **heap;
+	size_t             nheap;
+};
+
+struct registry* registry_new(void);
+
+/* free the registry, but not the collectors in it */
+void registry_free(struct registry *r);
+
+/* add a collector to the registry, which takes ownership of
+   it; returns 0 on success, or 1 if we are out of memory. */
+int registry_add(struct registry *r, struct collector *c);
+
+/* put a collector (back) on the schedule, at c->next */
+void registry_schedule(struct registry *r, struct collector *c);
+
+/* take the next collector due at or before `t' off of the
+   schedule, or return NULL if nothing is due yet. */
+struct collector* registry_due(struct registry *r, int64_t t);
+
+/* when the next scheduled collector is due, or -1 if there
+   aren't any. */
+int64_t registry_next(struct registry *r);
+
+#endif
@@ -0,0 +1,431 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rules.h"
+
+/* nodes refer to each other by index, so that the array can
+   grow; since the root is never anyone's child, 0 means none. */
+struct rnode {
+	unsigned char c;      /* the character that leads here      */
+	int           loops;  /* a `*' node, which matches anything */
+	int           kids;   /* first child                        */
+	int           sibling;
+	int           star;   /* the `*' child, if any              */
+	int           rule;   /* first rule that ends here, or -1   */
+	unsigned      mark;   /* the last `gen' this was seen in    */
+};
+
+/* a set of live trie nodes (sorted, so that sets compare), and
+   the rule that wins if the name ends here.  where each class of
+   character leads from dstate `s' (another dstate, DEAD, or
+   UNKNOWN, yet) is in r->next[s * r->nclasses + class]; keeping
+   them all in one table saves chasing a pointer per character. */
+struct dstate {
+	int     *set;
+	int      n;
+	int      rule;
+	uint32_t hash;
+};
+#define DEAD    -1
+#define UNKNOWN -2
+
+/* if some odd mix of names and rules keeps making new sets,
+   start the cache over rather than grow it without bound */
+#define MAX_DSTATES 1024
+
+#define MAX_STARS 16
+
+struct rules* rules_new(void)
+{
+	struct rules *r = calloc(1, sizeof(struct rules));
+	if (!r)
+		return NULL;
+
+	r->node    = calloc(16, sizeof(struct rnode));
+	r->scratch = calloc(16, sizeof(int));
+	if (!r->node || !r->scratch) {
+		rules_free(r);
+		return NULL;
+	}
+	r->cap_nodes    = 16;
+	r->nnodes       = 1;
+	r->node[0].rule = -1;
+	r->nclasses     = 1;
+	return r;
+}
+
+static void forget(struct rules *r)
+{
+	int i;
+
+	for (i = 0; i < r->ndfa; i++)
+		free(r->dfa[i].set);
+	free(r->dfa);
+	free(r->next);
+	r->dfa  = NULL;
+	r->next = NULL;
+	r->ndfa = r->cap_dfa = 0;
+}
+
+void rules_free(struct rules *r)
+{
+	int i;
+
+	if (!r)
+		return;
+	for (i = 0; i < r->n; i++) {
+		free(r->rule[i].pattern);
+		free(r->rule[i].rename);
+	}
+	forget(r);
+	free(r->rule);
+	free(r->node);
+	free(r->scratch);
+	free(r);
+}
+
+/* returns the index of a new node, or 0 if we are out of memory */
+static int node(struct rules *r, int c, int loops)
+{
+	struct rnode *n;
+	int *scratch, cap;
+
+	if (r->nnodes == r->cap_nodes) {
+		cap = r->cap_nodes * 2;
+		n   = realloc(r->node, cap * sizeof(struct rnode));
+		if (n) r->node = n;
+		scratch = realloc(r->scratch, cap * sizeof(int));
+		if (scratch) r->scratch = scratch;
+		if (!n || !scratch)
+			return 0;
+		r->cap_nodes = cap;
+	}
+
+	n = &r->node[r->nnodes];
+	memset(n, 0, sizeof(struct rnode));
+	n->c     = c;
+	n->loops = loops;
+	n->rule  = -1;
+	return r->nnodes++;
+}
+
+/* add `pat' to the trie, ending in rule `k' */
+static int compile(struct rules *r, const char *pat, int k)
+{
+	int at = 0, i;
+
+	for (; *pat; pat++) {
+		if (*pat == '*') {
+			if (!r->node[at].star) {
+				if (!(i = node(r, 0, 1)))
+					return 1;
+				r->node[at].star = i;
+			}
+			at = r->node[at].star;
+			continue;
+		}
+
+		if (!r->class[(unsigned char)*pat]) {
+			r->class[(unsigned char)*pat] = r->nclasses;
+			r->rep[r->nclasses++] = *pat;
+		}
+		for (i = r->node[at].kids; i; i = r->node[i].sibling)
+			if (r->node[i].c == (unsigned char)*pat)
+				break;
+		if (!i) {
+			if (!(i = node(r, (unsigned char)*pat, 0)))
+				return 1;
+			r->node[i].sibling = r->node[at].kids;
+			r->node[at].kids   = i;
+		}
+		at = i;
+	}
+
+	if (r->node[at].rule < 0)
+		r->node[at].rule = k;
+	forget(r); /* the old sets don't know about this rule */
+	return 0;
+}
+
+int rules_add(struct rules *r, const char *spec)
+{
+	struct rule *rule;
+	char *s, *action, *pattern, *rename, *extra, *p, *q;
+	int k;
+
+	s = strdup(spec);
+	if (!s)
+		return 1;
+	action  = strtok(s,    " \t");
+	pattern = strtok(NULL, " \t");
+	rename  = strtok(NULL, " \t");
+	extra   = strtok(NULL, " \t");
+
+	if (!action || !pattern || extra)
+		goto bad;
+	else if (strcmp(action, "include") == 0 && !rename) k = RULE_INCLUDE;
+	else if (strcmp(action, "exclude") == 0 && !rename) k = RULE_EXCLUDE;
+	else if (strcmp(action, "rename")  == 0 &&  rename) k = RULE_RENAME;
+	else
+		goto bad;
+
+	/* `**' is just a slower `*' */
+	for (p = q = pattern; *p; p++)
+		if (*p != '*' || q == pattern || q[-1] != '*')
+			*q++ = *p;
+	*q = '\0';
+
+	if (r->n == r->cap) {
+		rule = realloc(r->rule, (r->cap ? r->cap * 2 : 8) * sizeof(struct rule));
+		if (!rule)
+			goto oom;
+		r->rule = rule;
+		r->cap  = r->cap ? r->cap * 2 : 8;
+	}
+
+	rule = &r->rule[r->n];
+	memset(rule, 0, sizeof(struct rule));
+	rule->action  = k;
+	rule->pattern = strdup(pattern);
+	rule->rename  = rename ? strdup(rename) : NULL;
+	if (!rule->pattern || (rename && !rule->rename) || compile(r, rule->pattern, r->n) != 0) {
+		free(rule->pattern);
+		free(rule->rename);
+		goto oom;
+	}
+	r->n++;
+	free(s);
+	return 0;
+
+bad:
+	fprintf(stderr, "bad metric rule `metric:%s'; skipping\n", spec);
+	free(s);
+	return -1;
+
+oom:
+	free(s);
+	return 1;
+}
+
+/* add node `i' (and, since `*' can match nothing, its `*'
+   child) to the set being built */
+static void enter(struct rules *r, int *n, int i)
+{
+	for (; i && r->node[i].mark != r->gen; i = r->node[i].star) {
+		r->node[i].mark = r->gen;
+		r->scratch[(*n)++] = i;
+	}
+}
+
+static int by_index(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* find (or make) the dstate for the set of `n' nodes in
+   scratch; returns its index, DEAD, or -2 if out of memory */
+static int dstate(struct rules *r, int n)
+{
+	struct dstate *d;
+	uint32_t h = 2166136261u;
+	int i, *next, cap;
+
+	if (!n)
+		return DEAD;
+	qsort(r->scratch, n, sizeof(int), by_index);
+	for (i = 0; i < n; i++)
+		h = (h ^ r->scratch[i]) * 16777619u;
+
+	for (i = 0; i < r->ndfa; i++)
+		if (r->dfa[i].hash == h && r->dfa[i].n == n
+		 && memcmp(r->dfa[i].set, r->scratch, n * sizeof(int)) == 0)
+			return i;
+
+	if (r->ndfa == r->cap_dfa) {
+		cap  = r->cap_dfa ? r->cap_dfa * 2 : 16;
+		d    = realloc(r->dfa, cap * sizeof(struct dstate));
+		if (d) r->dfa = d;
+		next = realloc(r->next, cap * r->nclasses * sizeof(int));
+		if (next) r->next = next;
+		if (!d || !next)
+			return -2;
+		r->cap_dfa = cap;
+	}
+
+	d = &r->dfa[r->ndfa];
+	d->set = malloc(n * sizeof(int));
+	if (!d->set)
+		return -2;
+	memcpy(d->set, r->scratch, n * sizeof(int));
+	next = &r->next[r->ndfa * r->nclasses];
+	for (i = 0; i < r->nclasses; i++)
+		next[i] = UNKNOWN;
+	d->n    = n;
+	d->hash = h;
+	d->rule = -1;
+	for (i = 0; i < n; i++)
+		if (r->node[d->set[i]].rule >= 0 && (d->rule < 0 || r->node[d->set[i]].rule < d->rule))
+			d->rule = r->node[d->set[i]].rule;
+	return r->ndfa++;
+}
+
+static void generation(struct rules *r)
+{
+	int i;
+
+	if (++r->gen == 0) {
+		for (i = 0; i < r->nnodes; i++)
+			r->node[i].mark = 0;
+		r->gen = 1;
+	}
+}
+
+/* where character class `k' takes dstate `s' */
+static int step(struct rules *r, int s, int k)
+{
+	int i, j, n = 0, *set = r->dfa[s].set, len = r->dfa[s].n;
+	unsigned char c = r->rep[k];
+
+	generation(r);
+	for (i = 0; i < len; i++) {
+		if (r->node[set[i]].loops)
+			enter(r, &n, set[i]);
+		if (k == 0)
+			continue; /* nothing else takes this character */
+		for (j = r->node[set[i]].kids; j; j = r->node[j].sibling)
+			if (r->node[j].c == c) {
+				enter(r, &n, j);
+				break;
+			}
+	}
+	return dstate(r, n);
+}
+
+/* the start state: the root, and whatever `*'s hang off of it */
+static int start(struct rules *r)
+{
+	int n = 0;
+
+	if (r->ndfa)
+		return 0;
+	generation(r);
+	enter(r, &n, r->node[0].star);
+	r->scratch[n++] = 0;
+	return dstate(r, n);
+}
+
+struct rule* rules_match(struct rules *r, const char *name)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	const unsigned char *class = r->class;
+	int s, t, k, *next, nc;
+
+	if (!r->n)
+		return NULL;
+
+	if (r->ndfa >= MAX_DSTATES)
+		forget(r);
+	if ((s = start(r)) < 0)
+		return NULL;
+
+	next = r->next;
+	nc   = r->nclasses;
+	for (; *p; p++) {
+		k = class[*p];
+		t = next[s * nc + k];
+		if (t == UNKNOWN) {
+			t = step(r, s, k);
+			if (t == -2)
+				return NULL; /* out of memory; let it through */
+			next = r->next;
+			next[s * nc + k] = t;
+		}
+		if (t == DEAD)
+			return NULL;
+		s = t;
+	}
+	return r->dfa[s].rule < 0 ? NULL : &r->rule[r->dfa[s].rule];
+}
+
+/* match `name' against `pat' (which we already know matches),
+   noting what each `*' stood for */
+static int glob(const char *pat, const char *name, const char **from, size_t *len, int k)
+{
+	const char *e;
+
+	for (; *pat; pat++, name++) {
+		if (*pat != '*') {
+			if (*pat != *name)
+				return 0;
+			continue;
+		}
+		for (e = name; ; e++) {
+			if (k < MAX_STARS) {
+				from[k] = name;
+				len[k]  = e - name;
+			}
+			if (glob(pat + 1, e, from, len, k + 1))
+				return 1;
+			if (!*e)
+				return 0;
+		}
+	}
+	return !*name;
+}
+
+const char* rules_apply(struct rules *r, const char *name, char *buf, size_t len)
+{
+	struct rule *rule;
+	const char *from[MAX_STARS], *p;
+	size_t n[MAX_STARS], i, k;
+
+	rule = rules_match(r, name);
+	if (!rule)
+		return name;
+
+	rule->hits++;
+	if (rule->action == RULE_EXCLUDE)
+		return NULL;
+	if (rule->action == RULE_INCLUDE)
+		return name;
+
+	memset(n, 0, sizeof(n));
+	glob(rule->pattern, name, from, n, 0);
+	for (i = k = 0, p = rule->rename; *p && i < len - 1; p++) {
+		if (*p != '*') {
+			buf[i++] = *p;
+			continue;
+		}
+		if (k < MAX_STARS && n[k]) {
+			if (n[k] > len - 1 - i)
+				n[k] = len - 1 - i;
+			memcpy(buf + i, from[k], n[k]);
+			i += n[k];
+		}
+		k++;
+	}
+	buf[i] = '\0';
+	return buf;
+}
@@ -0,0 +1,93 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_RULES_H
+#define TINYBOLO_RULES_H
+
+#include <stddef.h>
+
+/* Metric rules, from `metric:' lines in the configuration:
+
+     metric:exclude *:diskio:dm-*
+     metric:include *:df:/run/shm:*
+     metric:exclude *:df:/run*
+     metric:rename  *:net:eth0:* *:net:wan:*
+
+   Patterns are matched against the whole metric name (prefix
+   and all); `*' matches any run of characters, and everything
+   else matches itself.  The first rule that matches decides:
+   excluded metrics are dropped, included ones are kept as-is,
+   and renamed ones get the new name, with each `*' in it
+   replaced by what the corresponding `*' in the pattern
+   matched.  Metrics that match no rule are kept.
+
+   All of the patterns are compiled into a single trie, with a
+   self-looping node for each `*'.  Matching walks that trie
+   with a set of live nodes, but each set (and where each
+   character takes it) is only worked out once, the first time
+   it comes up, and cached; after that, a name costs one table
+   lookup per character, however many rules there are. */
+#define RULE_INCLUDE 0
+#define RULE_EXCLUDE 1
+#define RULE_RENAME  2
+
+struct rule {
+	int            action;
+	char          *pattern;
+	char          *rename;  /* RULE_RENAME only */
+	unsigned long  hits;
+};
+
+struct rnode;
+struct dstate;
+struct rules {
+	struct rule   *rule;
+	int            n, cap;
+
+	struct rnode  *node;     /* the trie; node[0] is the root */
+	int            nnodes, cap_nodes;
+	int           *scratch;  /* room for a set of nodes */
+	unsigned       gen;
+
+	unsigned char  class[256]; /* characters that act the same */
+	unsigned char  rep[256];   /* one character from each class */
+	int            nclasses;
+	struct dstate *dfa;      /* sets of nodes seen so far; */
+	int           *next;     /* dfa[0] is the start */
+	int            ndfa, cap_dfa;
+};
+
+struct rules* rules_new(void);
+void rules_free(struct rules *r);
+
+/* add a rule, i.e. "exclude PATTERN" (the bit after
+   `metric:'); returns 0 on success, -1 if it makes no sense
+   (and says why), or 1 if we ran out of memory. */
+int rules_add(struct rules *r, const char *spec);
+
+/* the first rule that matches `name', or NULL */
+struct rule* rules_match(struct rules *r, const char *name);
+
+/* run `name' through the rules, counting hits; returns NULL if
+   it should be dropped, or the name to use (either `name' itself,
+   or `buf', holding the new name). */
+const char* rules_apply(struct rules *r, const char *name, char *buf, size_t len);
+
+#endif
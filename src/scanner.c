@@ -0,0 +1,156 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "scanner.h"
+
+#define SCANNER_CHUNK 65536
+
+void scanner_init(struct scanner *s, int fd, size_t max)
+{
+	s->fd       = fd;
+	s->start    = s->end = s->scanned = 0;
+	s->max      = max;
+	s->skipping = 0;
+	s->eof      = 0;
+	s->overlong = 0;
+}
+
+void scanner_free(struct scanner *s)
+{
+	free(s->buf);
+	s->buf = NULL;
+	s->cap = 0;
+}
+
+/* make room for at least SCANNER_CHUNK more bytes, shifting
+   unconsumed data down to the front of the buffer first */
+static int room(struct scanner *s)
+{
+	char *p;
+	size_t cap;
+
+	if (s->start) {
+		memmove(s->buf, s->buf + s->start, s->end - s->start);
+		s->end     -= s->start;
+		s->scanned -= s->start;
+		s->start    = 0;
+	}
+	if (s->cap - s->end >= SCANNER_CHUNK / 2)
+		return 0;
+
+	for (cap = s->cap ? s->cap : SCANNER_CHUNK; cap - s->end < SCANNER_CHUNK / 2; cap *= 2);
+	p = realloc(s->buf, cap + 1);
+	if (!p)
+		return 1;
+	s->buf = p;
+	s->cap = cap;
+	return 0;
+}
+
+char* scanner_line(struct scanner *s, size_t *len)
+{
+	char *line, *nl;
+	ssize_t n;
+
+	for (;;) {
+		nl = s->end > s->scanned ? memchr(s->buf + s->scanned, '\n', s->end - s->scanned) : NULL;
+		if (nl) {
+			line = s->buf + s->start;
+			*nl = '\0';
+			s->start = s->scanned = nl - s->buf + 1;
+			if (s->skipping) {
+				s->skipping = 0;
+				continue;
+			}
+			if (len)
+				*len = nl - line;
+			return line;
+		}
+
+		s->scanned = s->end;
+		if (s->end - s->start > s->max) {
+			/* too long; drop what we have, and the rest of it
+			   when it shows up */
+			if (!s->skipping)
+				s->overlong++;
+			s->skipping = 1;
+			s->start = s->scanned = s->end;
+		}
+
+		if (s->eof)
+			break;
+		if (room(s) != 0) {
+			s->eof = 1;
+			break;
+		}
+		n = read(s->fd, s->buf + s->end, s->cap - s->end);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return NULL;
+		if (n <= 0) {
+			s->eof = 1;
+			break;
+		}
+		s->end += n;
+	}
+
+	/* end of file; hand out any unterminated last line */
+	if (s->start == s->end || s->skipping) {
+		s->start = s->scanned = s->end;
+		return NULL;
+	}
+	line = s->buf + s->start;
+	s->buf[s->end] = '\0';
+	if (len)
+		*len = s->end - s->start;
+	s->start = s->scanned = s->end;
+	return line;
+}
+
+char* scanner_field(char **p)
+{
+	char *a, *b;
+
+	for (a = *p; *a == ' ' || *a == '\t' || *a == '\r'; a++);
+	if (!*a) {
+		*p = a;
+		return NULL;
+	}
+	for (b = a; *b && *b != ' ' && *b != '\t' && *b != '\r'; b++);
+	if (*b)
+		*b++ = '\0';
+	*p = b;
+	return a;
+}
+
+char* scanner_rest(char **p)
+{
+	char *a;
+
+	for (a = *p; *a == ' ' || *a == '\t'; a++);
+	*p = a + strlen(a);
+	return a;
+}
@@ -0,0 +1,73 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_SCANNER_H
+#define TINYBOLO_SCANNER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* A line scanner over a file descriptor.  Data is read in
+   large chunks into a buffer that grows as needed, so lines
+   of any length (up to `max' bytes) come out whole; lines
+   are handed out in place, NUL-terminated, without copying.
+   Longer lines are thrown away, up to the next newline, and
+   counted in `overlong'.
+
+   Newlines are found with memchr(), which libc vectorizes,
+   rather than a byte at a time.
+
+   Works on blocking and non-blocking descriptors alike; see
+   scanner_line(). */
+struct scanner {
+	int     fd;
+	char   *buf;
+	size_t  cap;
+	size_t  start;    /* unconsumed data is buf[start, end)   */
+	size_t  end;
+	size_t  scanned;  /* buf[start, scanned) has no newline   */
+	size_t  max;      /* longest line we will hand out        */
+	int     skipping; /* discarding the rest of a long line   */
+	int     eof;      /* read() hit end-of-file (or an error) */
+	unsigned long overlong;
+};
+
+/* set up `s' to read from `fd'.  A scanner that has been
+   used before keeps its buffer; one that is all zeroes
+   allocates on first read. */
+void scanner_init(struct scanner *s, int fd, size_t max);
+void scanner_free(struct scanner *s);
+
+/* return the next whole line (without its newline), reading
+   more as needed, or NULL if there isn't one yet.  When the
+   descriptor is non-blocking, NULL with `eof' unset means
+   "try again later".  At end-of-file, an unterminated last
+   line is returned as if it had a newline. */
+char* scanner_line(struct scanner *s, size_t *len);
+
+/* split the next whitespace-delimited field off of a line,
+   NUL-terminating it in place and advancing *p past it;
+   returns NULL if there are no more fields. */
+char* scanner_field(char **p);
+
+/* whatever is left of a line, less leading whitespace */
+char* scanner_rest(char **p);
+
+#endif
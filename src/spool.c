@@ -0,0 +1,227 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spool.h"
+
+#define SPOOL_MAGIC "TBSPOOL1"
+#define SPOOL_FILE  "/spool"
+
+/* records are stored as a 32-bit length (of what follows),
+   a single byte frame count, and then the NUL-terminated
+   frames themselves; records are padded out to 4 bytes. */
+#define RECORD_HDR    5
+#define ALIGN(n)      (((n) + 3) & ~3)
+#define RECORD_LEN(r) (*(uint32_t *)(r))
+
+static void reset(struct spool *s)
+{
+	memcpy(s->hdr->magic, SPOOL_MAGIC, 8);
+	s->hdr->size  = s->size;
+	s->hdr->head  = ALIGN(sizeof(struct spool_header));
+	s->hdr->tail  = s->hdr->head;
+	s->hdr->count = 0;
+}
+
+static int valid(struct spool *s)
+{
+	uint32_t start = ALIGN(sizeof(struct spool_header));
+
+	return memcmp(s->hdr->magic, SPOOL_MAGIC, 8) == 0
+	    && s->hdr->size == s->size
+	    && s->hdr->tail >= start
+	    && s->hdr->tail <= s->hdr->head
+	    && s->hdr->head <= s->size;
+}
+
+struct spool* spool_open(const char *dir, size_t size)
+{
+	struct spool *s;
+	struct stat st;
+	char *path;
+	int existed;
+
+	if (size < 4096)
+		size = 4096;
+	if (size > SPOOL_MAX) {
+		fprintf(stderr, "spool size %lu is too big (max %lu)\n",
+			(unsigned long)size, (unsigned long)SPOOL_MAX);
+		return NULL;
+	}
+
+	path = malloc(strlen(dir) + strlen(SPOOL_FILE) + 1);
+	s = calloc(1, sizeof(struct spool));
+	if (!path || !s)
+		goto fail;
+	strcpy(path, dir);
+	strcat(path, SPOOL_FILE);
+
+	s->size = size;
+	s->fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (s->fd < 0) {
+		fprintf(stderr, "failed to open spool %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	fcntl(s->fd, F_SETFD, FD_CLOEXEC);
+
+	if (fstat(s->fd, &st) != 0) {
+		fprintf(stderr, "failed to stat spool %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	existed = st.st_size == (off_t)size;
+
+	if (!existed && ftruncate(s->fd, size) != 0) {
+		fprintf(stderr, "failed to size spool %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+
+	s->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->base == MAP_FAILED) {
+		fprintf(stderr, "failed to map spool %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	s->hdr = (struct spool_header *)s->base;
+
+	if (!existed || !valid(s)) {
+		if (st.st_size)
+			fprintf(stderr, "spool %s is unusable (or was resized); starting over\n", path);
+		reset(s);
+	}
+
+	free(path);
+	return s;
+
+fail:
+	if (s && s->fd >= 0)
+		close(s->fd);
+	free(path);
+	free(s);
+	return NULL;
+}
+
+int spool_put(struct spool *s, struct metric *m)
+{
+	uint32_t len = RECORD_HDR, need;
+	char *r;
+	int i;
+
+	for (i = 0; i < m->n; i++)
+		len += strlen(m->frame[i]) + 1;
+	need = ALIGN(len);
+
+	if (s->hdr->head + need > s->size) {
+		/* out of room at the end of the segment; see if
+		   replaying has freed up some space at the front */
+		uint32_t start = ALIGN(sizeof(struct spool_header));
+		uint32_t used  = s->hdr->head - s->hdr->tail;
+
+		if (start + used + need > s->size) {
+			__atomic_add_fetch(&s->dropped, 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+		memmove(s->base + start, s->base + s->hdr->tail, used);
+		s->hdr->tail = start;
+		s->hdr->head = start + used;
+	}
+
+	r = s->base + s->hdr->head;
+	RECORD_LEN(r) = len - 4;
+	r[4] = m->n;
+	for (r += RECORD_HDR, i = 0; i < m->n; i++) {
+		size_t n = strlen(m->frame[i]) + 1;
+		memcpy(r, m->frame[i], n);
+		r += n;
+	}
+
+	/* only move the head once the record is in place, so
+	   that a crash mid-append doesn't leave garbage behind */
+	s->hdr->head += need;
+	__atomic_add_fetch(&s->hdr->count, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+struct metric* spool_peek(struct spool *s)
+{
+	const char *r, *end, *f[METRIC_FRAMES] = { 0 };
+	int i, n;
+
+	if (s->hdr->tail == s->hdr->head)
+		return NULL;
+
+	r   = s->base + s->hdr->tail;
+	end = r + 4 + RECORD_LEN(r);
+	n   = r[4];
+	if (n < 1 || n > METRIC_FRAMES || end > s->base + s->hdr->head)
+		goto corrupt;
+
+	for (r += RECORD_HDR, i = 0; i < n; i++) {
+		f[i] = r;
+		r = memchr(r, '\0', end - r);
+		if (!r)
+			goto corrupt;
+		r++;
+	}
+	return metric_new(n, f[0], f[1], f[2], f[3], f[4]);
+
+corrupt:
+	fprintf(stderr, "spool is corrupt; discarding %u spooled metrics\n", s->hdr->count);
+	reset(s);
+	return NULL;
+}
+
+void spool_shift(struct spool *s)
+{
+	uint32_t start = ALIGN(sizeof(struct spool_header));
+
+	if (s->hdr->tail == s->hdr->head)
+		return;
+
+	s->hdr->tail += ALIGN(RECORD_LEN(s->base + s->hdr->tail) + 4);
+	__atomic_sub_fetch(&s->hdr->count, 1, __ATOMIC_RELAXED);
+
+	if (s->hdr->tail >= s->hdr->head) {
+		/* all caught up; start the segment over */
+		s->hdr->head = s->hdr->tail = start;
+		s->hdr->count = 0;
+	}
+}
+
+void spool_sync(struct spool *s)
+{
+	msync(s->base, s->size, MS_ASYNC);
+}
+
+unsigned long spool_depth(struct spool *s)
+{
+	return __atomic_load_n(&s->hdr->count, __ATOMIC_RELAXED);
+}
+
+unsigned long spool_dropped(struct spool *s)
+{
+	return __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+}
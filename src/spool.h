@@ -0,0 +1,80 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TINYBOLO_SPOOL_H
+#define TINYBOLO_SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "queue.h"
+
+/* An on-disk spool, for holding metrics while bolo is
+   unreachable.  The spool is a single, fixed-size segment
+   file, mapped into memory.  Records are appended at the
+   head, and replayed (in order) from the tail; once they
+   have all been replayed, the segment starts over from the
+   beginning.  When the segment fills up, new records are
+   dropped until enough of the backlog has been replayed.
+
+   Since the head and tail live in the file, along with the
+   records, whatever is left in the spool when tinybolo
+   exits is picked up again when it starts back up.
+
+   Only one thread may use a spool; the _depth() and
+   _dropped() accessors are safe to call from others. */
+struct spool_header {
+	char     magic[8];  /* "TBSPOOL1"                   */
+	uint32_t size;      /* size of the whole segment    */
+	uint32_t head;      /* offset of the next append    */
+	uint32_t tail;      /* offset of the oldest record  */
+	uint32_t count;     /* how many records are spooled */
+};
+
+/* offsets in the header are 32-bit, so that is as big as it gets */
+#define SPOOL_MAX UINT32_MAX
+
+struct spool {
+	int                  fd;
+	size_t               size;
+	unsigned long        dropped;
+	struct spool_header *hdr;
+	char                *base;
+};
+
+struct spool* spool_open(const char *dir, size_t size);
+
+/* append a metric; returns 0 on success, or 1 if
+   there was no room and it had to be dropped. */
+int spool_put(struct spool *s, struct metric *m);
+
+/* return a copy of the oldest spooled metric (which
+   the caller must free), or NULL if it is empty. */
+struct metric* spool_peek(struct spool *s);
+
+/* discard the oldest spooled metric */
+void spool_shift(struct spool *s);
+
+void spool_sync(struct spool *s);
+
+unsigned long spool_depth(struct spool *s);
+unsigned long spool_dropped(struct spool *s);
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
@@ -26,17 +27,95 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
 #include <zmq.h>
 
+#include "collectors.h"
+#include "queue.h"
+#include "spool.h"
+#include "batch.h"
+#include "compress.h"
+#include "scanner.h"
+#include "registry.h"
+#include "launch.h"
+#include "aggregate.h"
+#include "fanout.h"
+#include "rules.h"
+#include "capture.h"
+
 static int debug      = 0;
 static int interval   = 30;
 static int foreground = 0;
-static char *endpoint = "tcp://127.0.0.1:2999";
+static int max_jobs   = 4;
+static int timeout    = 60;
+static int splay      = 1;
+static int watch      = 0;
+
+#define MAX_ENDPOINTS 16
+static char          *endpoints[MAX_ENDPOINTS] = { "tcp://127.0.0.1:2999" };
+static int            nendpoints = 0; /* how many -e options we've seen */
+static int            fpolicy    = FANOUT_FAILOVER;
+static struct fanout *F          = NULL;
 static char *config   = "/etc/tinybolo.conf";
 
-#define COMMAND_MAX 8192
-static char commands[COMMAND_MAX] = { 0 };
+static unsigned long qsize   = 4096;
+static int           qpolicy = QUEUE_DROP_OLDEST;
+static struct queue *Q       = NULL;
+
+static char         *spool_dir   = NULL;
+static size_t        spool_size  = 16;  /* megabytes */
+static int           replay_rate = 100; /* metrics / second */
+static struct spool *S           = NULL;
+
+static int           batch_max   = 0;   /* metrics per batch (0 = off) */
+static size_t        batch_size  = 64;  /* kilobytes per batch */
+
+/* metrics waiting to go out in a batch; one per shard */
+struct outbox {
+	struct batch    b;
+	struct metric **m;
+};
+static struct outbox *outboxes  = NULL;
+static int            noutboxes = 0;
+
+static int           zalgo       = COMPRESS_NONE;
+static int           zlevel      = 0;
+static char         *zbuf        = NULL;
+static size_t        zcap        = 0;
+static unsigned long zin, zout, zusec; /* bytes in / out, CPU time */
+
+static int               local_rates = 0; /* turn RATEs into SAMPLEs here? */
+static int               rollup      = 0; /* seconds per SAMPLE rollup (0 = off) */
+static struct aggregate *A           = NULL;
+static int               dedup       = 0; /* resend unchanged values every N runs */
+static struct aggregate *D           = NULL;
+static struct rules     *M           = NULL; /* metric: rules, from the config */
+
+static char             *record_to    = NULL; /* -W */
+static struct capture   *W            = NULL;
+static char             *replay_from  = NULL; /* a capture to play back (-P) */
+static double            replay_speed = 1;    /* -x; 0 = as fast as we can */
+static int               replay_hosts = 1;    /* -k */
+static unsigned long     nsent;               /* metrics the sender is done with */
+static unsigned long     ndelivered;          /* ...that an endpoint actually took */
+static int               stopping;            /* tells the sender to finish up */
+
+static char  self[256];       /* our hostname                      */
+static char *self_prefix = NULL; /* prefix for our own metrics     */
+
+/* self-instrumentation; the first two are only touched by the
+   main thread, the rest by the sender, so we use atomics there */
+static unsigned long nlines, nbad;          /* lines parsed / rejected */
+static unsigned long send_errors, send_eagain;
+static unsigned long nspawns, spawn_usec;   /* main thread only */
+static unsigned long ndedup, nsuppressed;   /* main thread only */
 
 #define FALLBACK(string,fallback) (*(string) ? (string) : (fallback))
 
@@ -44,51 +123,1223 @@ static char commands[COMMAND_MAX] = { 0 };
 
 void bail(void)
 {
-	fprintf(stderr, "USAGE: tinybolo -i 30 -c /etc/tinybolo.conf -e tcp://10.0.0.1:2999\n");
+	fprintf(stderr, "USAGE: tinybolo -i 30 [-n] -j 4 -t 60 -q 4096 -Q drop-oldest -s /var/spool/tinybolo -S 16 -r 100 -b 0 -B 64 -z lz4 -Z 1 -c /etc/tinybolo.conf -e tcp://10.0.0.1:2999 [-e ...] -E failover -p host:tinybolo [-w] [-W capture | -P capture -x 1 -k 1] [-R] -A 0 -d 0\n");
 	exit(1);
 }
 
-static int zsend(void *z, const char *s, int flags)
+static int64_t now_ms(void)
+{
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_nsec / 1000000;
+}
+
+static int64_t now_us(int clock)
+{
+	struct timespec tv;
+	clock_gettime(clock, &tv);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+/* count a send that didn't go through, anywhere */
+static void failed(void)
+{
+	if (errno != EAGAIN)
+		__atomic_add_fetch(&send_errors, 1, __ATOMIC_RELAXED);
+	else
+		__atomic_add_fetch(&send_eagain, 1, __ATOMIC_RELAXED);
+}
+
+/* metrics are sharded by name, which is always the third frame */
+static int shard(const struct metric *m)
 {
-	int rc;
+	return fanout_shard(F, m->frame[m->n > 2 ? 2 : 0]);
+}
 
-	if (!s) rc = zmq_send(z, "", 0,             flags);
-	else    rc = zmq_send(z, s,  strlen(s) + 1, flags);
+/* with ZMQ_DONTWAIT in `flags', this fails with EAGAIN (and
+   sends nothing) if no endpoint can take the metric now */
+static int send_frames(struct metric *m, int flags)
+{
+	struct iovec msg[METRIC_FRAMES + 1];
+	int i;
 
-	if (rc < 0) {
-		fprintf(stderr, "zmq_send failed: %s\n", zmq_strerror(errno));
+	msg[0].iov_base = "";
+	msg[0].iov_len  = 0;
+	for (i = 0; i < m->n; i++) {
+		msg[i + 1].iov_base = m->frame[i];
+		msg[i + 1].iov_len  = strlen(m->frame[i]) + 1;
+	}
+
+	if (fanout_send(F, shard(m), msg, m->n + 1, flags) != 0) {
+		failed();
 		return 1;
 	}
+
+	debugf("  >> [");
+	for (i = 0; i < m->n; i++)
+		debugf("%s%c", m->frame[i], i == m->n - 1 ? ']' : '|');
+	debugf("\n");
 	return 0;
 }
 
-static int send_frames(void *z, int n, ...)
+/* replay what we can from the spool, without going over
+   replay_rate metrics per second.  `credit' is measured in
+   metric-milliseconds, so that we don't need floating point. */
+static void replay(void)
 {
-	if (zsend(z, NULL, ZMQ_SNDMORE) != 0) return 1;
-	debugf("  >> [");
+	static int64_t last = 0, credit = 0;
+	struct metric *m;
+	int64_t t = now_ms();
+
+	credit += (t - last) * replay_rate;
+	if (credit > replay_rate * 1000)
+		credit = replay_rate * 1000;
+	last = t;
+
+	while (credit >= 1000 && (m = spool_peek(S)) != NULL) {
+		if (send_frames(m, ZMQ_DONTWAIT) != 0) {
+			free(m);
+			break;
+		}
+		free(m);
+		spool_shift(S);
+		__atomic_add_fetch(&ndelivered, 1, __ATOMIC_RELAXED);
+		credit -= 1000;
+	}
+}
+
+/* send a single metric, or spool it if we can't; frees `m' */
+static void deliver(struct metric *m)
+{
+	if (send_frames(m, S ? ZMQ_DONTWAIT : 0) == 0)
+		__atomic_add_fetch(&ndelivered, 1, __ATOMIC_RELAXED);
+	else if (S && errno == EAGAIN && spool_put(S, m) != 0)
+		debugf("spool full; dropped a metric\n");
+	free(m);
+	__atomic_add_fetch(&nsent, 1, __ATOMIC_RELAXED);
+}
+
+/* send everything in an outbox as a single message.
+   if it can't go out now, the metrics are spooled one by
+   one; batches are a wire format, not a storage format. */
+#define BATCH_LINGER 5 /* ms to wait for more metrics to batch */
+static void flush(struct outbox *o)
+{
+	struct iovec msg[3];
+	int i;
+
+	if (!o->b.count)
+		return;
+
+	const char *frame = BATCH_FRAME, *blob = o->b.buf;
+	size_t len = o->b.len;
+
+	if (zalgo != COMPRESS_NONE) {
+		struct timespec t0, t1;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+		size_t n = compress(zalgo, zlevel, o->b.buf, o->b.len, zbuf, zcap);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+		__atomic_add_fetch(&zusec, (t1.tv_sec - t0.tv_sec) * 1000000L
+		                         + (t1.tv_nsec - t0.tv_nsec) / 1000, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&zin,  o->b.len,    __ATOMIC_RELAXED);
+		__atomic_add_fetch(&zout, n ? n : len, __ATOMIC_RELAXED);
+
+		if (n) {
+			frame = compress_frame_name(zalgo);
+			blob  = zbuf;
+			len   = n;
+		}
+	}
+
+	msg[0].iov_base = "";           msg[0].iov_len = 0;
+	msg[1].iov_base = (char *)frame; msg[1].iov_len = strlen(frame) + 1;
+	msg[2].iov_base = (char *)blob;  msg[2].iov_len = len;
+
+	if (fanout_send(F, o - outboxes, msg, 3, S ? ZMQ_DONTWAIT : 0) != 0) {
+		failed();
+		if (S && errno == EAGAIN)
+			for (i = 0; i < o->b.count; i++)
+				if (spool_put(S, o->m[i]) != 0)
+					debugf("spool full; dropped a metric\n");
+	} else {
+		debugf("  >> [%s of %i metrics, %lu bytes]\n", frame, o->b.count, (unsigned long)len);
+		__atomic_add_fetch(&ndelivered, o->b.count, __ATOMIC_RELAXED);
+	}
+
+	for (i = 0; i < o->b.count; i++)
+		free(o->m[i]);
+	__atomic_add_fetch(&nsent, o->b.count, __ATOMIC_RELAXED);
+	batch_reset(&o->b);
+}
+
+/* add a metric to its outbox, sending the outbox off if it
+   fills up; frees (or hangs on to) `m' */
+static void batch(struct metric *m)
+{
+	struct outbox *o = &outboxes[shard(m)];
+
+	if (batch_add(&o->b, m) != 0) {
+		flush(o);
+		if (batch_add(&o->b, m) != 0) {
+			deliver(m); /* too big to batch */
+			return;
+		}
+	}
+	o->m[o->b.count - 1] = m;
+	if (o->b.count >= batch_max)
+		flush(o);
+}
+
+/* the sender thread owns the 0MQ sockets, and is the only
+   consumer of the queue; everything else just submit()s.
+
+   with a spool, we never block on the sockets; anything they
+   won't take right now goes to disk, and is replayed later.
+   new metrics still go straight out whenever they can, so
+   replayed ones arrive after (newer) ones sent since.
 
+   in batch mode (-b), metrics are packed together until the
+   batch is full, or the queue stays empty for BATCH_LINGER
+   milliseconds (usually, the end of a collector run).  when
+   sharding (-E shard), each shard gets its own batch. */
+static void* sender(void *unused)
+{
+	struct metric *m;
+	sigset_t all;
+	int64_t synced = 0, recorded = 0;
+	int i, waiting;
+
+	/* leave signal handling to the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+		for (waiting = i = 0; i < noutboxes; i++)
+			waiting += outboxes[i].b.count;
+
+		if (waiting)
+			m = queue_pop(Q, BATCH_LINGER);
+		else
+			m = queue_pop(Q, S && spool_depth(S) ? 100 : 1000);
+
+		if (m && W && capture_write(W, now_us(CLOCK_REALTIME), m) != 0)
+			debugf("failed to record a metric\n");
+
+		if (!m)
+			for (i = 0; i < noutboxes; i++)
+				flush(&outboxes[i]);
+		else if (!batch_max)
+			deliver(m);
+		else
+			batch(m);
+
+		if (W && now_ms() - recorded >= 1000) {
+			capture_flush(W);
+			recorded = now_ms();
+		}
+		if (S && spool_depth(S)) {
+			replay();
+			if (now_ms() - synced >= 1000) {
+				spool_sync(S);
+				synced = now_ms();
+			}
+		}
+	}
+
+	for (i = 0; i < noutboxes; i++)
+		flush(&outboxes[i]);
+	if (S)
+		spool_sync(S);
+	return NULL;
+}
+
+/* returns 0 if the metric was handed to the queue (which may
+   still drop something, if it is full and not blocking), or 1
+   if it couldn't even be allocated */
+static int submit(int n, ...)
+{
+	struct metric *m;
 	va_list ap;
+
 	va_start(ap, n);
+	m = metric_newv(n, ap);
+	va_end(ap);
 
-	int i;
-	for (i = n; i > 0; i--) {
-		const char *s = va_arg(ap, const char *);
-		if (zsend(z, s, i == 1 ? 0 : ZMQ_SNDMORE) != 0) return 1;
-		debugf("%s%c", s, i == 1 ? ']' : '|');
+	if (!m) {
+		debugf("failed to allocate metric: %s\n", strerror(errno));
+		return 1;
 	}
-	debugf("\n");
+	if (queue_push(Q, m) != 0)
+		debugf("queue full; dropped a metric\n");
+	return 0;
+}
+
+/* hand a SAMPLE or RATE to the sender, unless it hasn't
+   changed since last time (and it isn't time for a heartbeat) */
+static void send_value(struct collector *c, const char *type, const char *ts,
+                       const char *name, const char *value)
+{
+	if (c->dedup) {
+		ndedup++;
+		if (!aggregate_dedup(D, name, value, now_ms(), c->dedup)) {
+			nsuppressed++;
+			return;
+		}
+	}
+	submit(4, type, ts, name, value);
+}
+
+/* send a SAMPLE or RATE on, unless the collector wants us to
+   work out rates (see aggregate.h) or roll samples up first */
+static void publish(struct collector *c, const char *type, const char *ts,
+                    const char *name, const char *value)
+{
+	char v[64];
+	double rate;
+
+	if (*type == 'R' && c->rates) {
+		switch (aggregate_rate(A, name, value, now_ms(), &rate)) {
+		case 1:
+			snprintf(v, sizeof(v), "%0.2f", rate);
+			send_value(c, "SAMPLE", ts, name, v);
+			return;
+		case 0:
+			return;
+		}
+		/* not a counter; pass it on as-is */
+
+	} else if (*type == 'S' && c->rollup) {
+		if (aggregate_sample(A, name, value, now_ms(), c->rollup) == 0)
+			return;
+	}
+	send_value(c, type, ts, name, value);
+}
+
+/* aggregate_flush() callback, for finished rollups */
+static void rolled_up(const char *name, const char *stat, double v)
+{
+	char ts[16], metric[1024], value[64];
+
+	snprintf(ts, sizeof(ts), "%li", (long)time(NULL));
+	if (stat)
+		snprintf(metric, sizeof(metric), "%s:%s", name, stat);
+	snprintf(value, sizeof(value), stat && *stat == 'c' ? "%0.0f" : "%0.2f", v);
+	submit(4, "SAMPLE", ts, stat ? metric : name, value);
+}
+
+static void parse_line(struct collector *c, char *buf)
+{
+	char *type, *ts, *val, prefixed[1024], renamed[1024];
+	const char *name;
+
+	if (!(type = scanner_field(&buf)))
+		return; /* blank lines are neither here nor there */
+
+	nlines++;
+	if (!(ts = scanner_field(&buf)) || !(name = scanner_field(&buf)))
+		goto bad;
+	if (c->prefix) {
+		snprintf(prefixed, sizeof(prefixed), "%s:%s", c->prefix, name);
+		name = prefixed;
+	}
+	if (!(name = rules_apply(M, name, renamed, sizeof(renamed))))
+		return; /* excluded */
+
+	if (strcmp(type, "STATE") == 0) {
+		debugf("STATEs are not supported\n");
+		if (!(val = scanner_field(&buf)))
+			goto bad;
+		submit(5, "STATE", ts, name, val, scanner_rest(&buf));
+
+	} else if (strcmp(type, "COUNTER") == 0) {
+		val = scanner_rest(&buf);
+		submit(4, "COUNTER", ts, name, FALLBACK(val, "1"));
+
+	} else if (strcmp(type, "SAMPLE") == 0) {
+		if (!(val = scanner_field(&buf)))
+			goto bad;
+		publish(c, "SAMPLE", ts, name, val);
+
+	} else if (strcmp(type, "RATE") == 0) {
+		if (!(val = scanner_field(&buf)))
+			goto bad;
+		publish(c, "RATE", ts, name, val);
+
+	} else if (strcmp(type, "EVENT") == 0) {
+		val = scanner_rest(&buf);
+		submit(4, "EVENT", ts, name, val);
+
+	} else {
+		goto bad;
+	}
+	return;
+
+bad:
+	debugf("unparseable line from collector\n");
+	nbad++;
+}
+
+static void self_metric(const char *type, const char *name, const char *fmt, ...)
+{
+	char ts[16], metric[512], value[64];
+	va_list ap;
+
+	snprintf(ts, sizeof(ts), "%li", (long)time(NULL));
+	snprintf(metric, sizeof(metric), "%s:%s", self_prefix, name);
+	va_start(ap, fmt);
+	vsnprintf(value, sizeof(value), fmt, ap);
 	va_end(ap);
+	submit(4, type, ts, metric, value);
+}
+
+/* builtin collectors run inside of tinybolo itself, and hand
+   their metrics straight to send_frames(), instead of printing
+   them out for us to parse back in.  configured as
+
+     builtin:openwrt myhost.example.com
 
+   where the argument is the metric prefix to use. */
+static struct builtin {
+	const char *name;
+	int (*run)(struct emitter *);
+} BUILTINS[] = {
+	{ "openwrt", collect_all },
+	{ NULL, NULL },
+};
+
+static struct builtin* builtin(const char *cmd, const char **arg)
+{
+	struct builtin *b;
+	size_t n;
+
+	if (strncmp(cmd, "builtin:", 8) != 0)
+		return NULL;
+
+	cmd += 8;
+	for (n = 0; cmd[n] && !isspace(cmd[n]); n++);
+	for (*arg = cmd + n; **arg && isspace(**arg); (*arg)++);
+
+	for (b = BUILTINS; b->name; b++)
+		if (strlen(b->name) == n && strncmp(b->name, cmd, n) == 0)
+			return b;
+	return NULL;
+}
+
+/* what to call a collector in our own metrics, if it has no
+   name=: the basename of the command (or builtin) it runs,
+   i.e. `disk-usage' or `openwrt'. */
+static void collector_name(struct collector *c, const char *a, const char *b)
+{
+	size_t i;
+
+	if (!a) {
+		a = c->cmd;
+		if (strncmp(a, "builtin:", 8) == 0)
+			a += 8;
+		for (b = a; *b && !isspace(*b); b++)
+			if (*b == '/')
+				a = b + 1;
+	}
+	for (i = 0; a < b && i < sizeof(c->name) - 1; a++, i++)
+		c->name[i] = isalnum(*a) || *a == '-' || *a == '_' || *a == '.' ? *a : '_';
+	c->name[i] = '\0';
+}
+
+/* turn a line of config into a collector.  lines can start
+   with `key=value' options, which override the global defaults
+   for just that collector, i.e.
+
+     timeout=5 /usr/lib/collectors/nfs-health
+     interval=300 type=exec /usr/lib/collectors/disk-usage
+     type=stream /usr/lib/collectors/syslog-tail
+     name=nfs sh -c 'check-nfs /mnt/a /mnt/b'
+     prefix=myhost:app /usr/lib/collectors/app-stats
+     rates=local rollup=60 builtin:openwrt myhost
+     dedup=10 /usr/lib/collectors/disk-usage
+     ifaces=eth*,wg*,!veth* builtin:openwrt myhost
+
+   returns NULL (and says why) if the line is no good. */
+#define OPTION(a,b,k) (strlen(k) == (size_t)((b) - (a) + 1) && strncmp((a), (k), (b) - (a) + 1) == 0)
+#define VALUE(b,v)    (strncmp((b) + 1, (v), strlen(v)) == 0 && \
+                       (!(b)[1 + strlen(v)] || isspace((b)[1 + strlen(v)])))
+static struct collector* configure(const char *line)
+{
+	struct collector *c;
+	struct builtin *bi;
+	const char *a, *b, *name = NULL, *arg;
+	char *end;
+	int v;
+
+	c = collector_new(line);
+	if (!c) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	c->type     = COLLECTOR_EXEC;
+	c->interval = interval * 1000;
+	c->timeout  = timeout;
+	c->rates    = local_rates;
+	c->rollup   = rollup * 1000;
+	c->dedup    = dedup;
+
+	for (a = c->line; *a; a = b) {
+		while (*a && isspace(*a)) a++;
+		for (b = a; *b && *b != '=' && !isspace(*b); b++);
+		if (*b != '=')
+			break;
+
+		if (OPTION(a, b, "timeout=")) {
+			v = strtol(b + 1, &end, 10);
+			if (end == b + 1 || (*end && !isspace(*end)) || v < 0)
+				goto bad;
+			c->timeout = v;
+
+		} else if (OPTION(a, b, "interval=")) {
+			v = strtol(b + 1, &end, 10);
+			if (end == b + 1 || (*end && !isspace(*end)) || v < 1)
+				goto bad;
+			c->interval = v * 1000;
+
+		} else if (OPTION(a, b, "rollup=")) {
+			v = strtol(b + 1, &end, 10);
+			if (end == b + 1 || (*end && !isspace(*end)) || v < 0)
+				goto bad;
+			c->rollup = v * 1000;
+
+		} else if (OPTION(a, b, "dedup=")) {
+			v = strtol(b + 1, &end, 10);
+			if (end == b + 1 || (*end && !isspace(*end)) || v < 0)
+				goto bad;
+			c->dedup = v;
+
+		} else if (OPTION(a, b, "rates=")) {
+			if (VALUE(b, "local"))
+				c->rates = 1;
+			else if (VALUE(b, "bolo"))
+				c->rates = 0;
+			else
+				goto bad;
+
+		} else if (OPTION(a, b, "name=")) {
+			name = b + 1;
+
+		} else if (OPTION(a, b, "prefix=")) {
+			free(c->prefix);
+			c->prefix = strndup(b + 1, strcspn(b + 1, " \t"));
+			if (!c->prefix || !*c->prefix)
+				goto bad;
+
+		} else if (OPTION(a, b, "ifaces=")) {
+			free(c->ifaces);
+			c->ifaces = strndup(b + 1, strcspn(b + 1, " \t"));
+			if (!c->ifaces || !*c->ifaces)
+				goto bad;
+
+		} else if (OPTION(a, b, "type=")) {
+			if (VALUE(b, "exec"))
+				c->type = COLLECTOR_EXEC;
+			else if (VALUE(b, "stream"))
+				c->type = COLLECTOR_STREAM;
+			else
+				goto bad;
+
+		} else {
+			goto bad;
+		}
+
+		for (b++; *b && !isspace(*b); b++);
+	}
+	if (!*a)
+		goto bad;
+	c->cmd = a;
+
+	if (name) {
+		for (b = name; *b && !isspace(*b); b++);
+		if (b == name)
+			goto bad;
+		collector_name(c, name, b);
+	} else {
+		collector_name(c, NULL, NULL);
+	}
+
+	if (strncmp(c->cmd, "builtin:", 8) == 0) {
+		if (c->type == COLLECTOR_STREAM) {
+			fprintf(stderr, "builtin collector `%s' cannot be a stream; skipping\n", c->cmd);
+			goto fail;
+		}
+		if (!(bi = builtin(c->cmd, &arg))) {
+			fprintf(stderr, "unknown builtin collector `%s'; skipping\n", c->cmd);
+			goto fail;
+		}
+		if (*arg) {
+			free(c->prefix);
+			c->prefix = strdup(arg);
+		}
+		if (!c->prefix || !*c->prefix) {
+			fprintf(stderr, "builtin collector `%s' needs a metric prefix; skipping\n", c->cmd);
+			goto fail;
+		}
+		c->type = COLLECTOR_BUILTIN;
+		c->data = bi;
+		return c;
+	}
+
+	c->argv = launch_argv(c->cmd);
+	if (c->argv)
+		debugf("running `%s' directly, without a shell\n", c->cmd);
+	else
+		c->argv = launch_shell(c->cmd);
+	if (!c->argv) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	return c;
+
+bad:
+	fprintf(stderr, "bad collector options in `%s'; skipping\n", line);
+fail:
+	collector_free(c);
+	return NULL;
+}
+#undef OPTION
+#undef VALUE
+
+static void emit_metric(struct emitter *e, const char *type, int32_t ts, const char *name, const char *value)
+{
+	char t[16], metric[1024], renamed[1024];
+
+	if (strcmp(type, "KEY") == 0)
+		return; /* not something we submit */
+
+	snprintf(t, sizeof(t), "%i", ts);
+	snprintf(metric, sizeof(metric), "%s:%s", e->prefix, name);
+	if (!(name = rules_apply(M, metric, renamed, sizeof(renamed))))
+		return; /* excluded */
+	if (strcmp(type, "SAMPLE") == 0 || strcmp(type, "RATE") == 0)
+		publish(e->data, type, t, name, value);
+	else
+		submit(4, type, t, name, value);
+}
+
+static void run_builtin(struct collector *c)
+{
+	struct builtin *b = c->data;
+	struct emitter e = {
+		.prefix = c->prefix,
+		.metric = emit_metric,
+		.data   = c,
+		.ifaces = c->ifaces,
+	};
+
+	debugf("running builtin `%s'\n", b->name);
+	if (b->run(&e) != 0)
+		debugf("builtin `%s' failed\n", b->name);
+}
+
+static void cloexec(int fd)
+{
+	fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+static void nonblocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* SIGCHLD and SIGHUP handler; wakes up the main loop via the
+   signal pipe, and for SIGHUP, asks it to reload the config */
+static int sigpipe[2] = { -1, -1 };
+static volatile sig_atomic_t hupped = 0;
+static void on_signal(int sig)
+{
+	int e = errno;
+	if (sig == SIGHUP)
+		hupped = 1;
+	if (write(sigpipe[1], "", 1) < 0) { /* pipe full; already awake */ }
+	errno = e;
+}
+
+/* To keep a fleet of tinybolos from all reporting in on the
+   same second, each host is given a fixed offset (its splay)
+   into every interval, derived from its hostname.  Collectors
+   run when the wall clock, less the splay, is a multiple of
+   their interval. */
+static uint32_t splay_hash(const char *s)
+{
+	uint32_t h = 2166136261u; /* FNV-1a */
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+	return h;
+}
+
+static int64_t first_run(int64_t t, int ms)
+{
+	struct timespec wall;
+	int64_t w, phase;
+
+	if (!splay)
+		return t;
+
+	clock_gettime(CLOCK_REALTIME, &wall);
+	w = (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000;
+	phase = (w - splay_hash(self) % ms) % ms;
+	if (phase < 0)
+		phase += ms;
+	return t + (ms - phase) % ms;
+}
+
+struct job {
+	pid_t       pid;     /* collector process (0 = free slot)    */
+	int         fd;      /* read end of its stdout pipe, or -1   */
+	int         poll;    /* index into the pollfd set, or 0      */
+	int         exited;  /* has the process been reaped?         */
+	int         status;  /* exit status, from wait4()            */
+	long        cpu;     /* user + system time (ms), from wait4() */
+	int64_t     started; /* when it was spawned (monotonic ms)   */
+	int64_t     kill_at; /* deadline (monotonic ms), or 0        */
+	struct collector *c; /* what it is running                   */
+
+	/* streaming collectors only */
+	int         stream;  /* is this a type=stream collector?     */
+	int         backoff; /* seconds to wait before respawning    */
+	int64_t     respawn; /* when to respawn it (monotonic ms)    */
+
+	struct scanner out;  /* its stdout                           */
+};
+
+/* the longest line we will take from a collector (or the
+   config file); anything longer is dropped, not split up. */
+#define LINE_MAX_BYTES (1024 * 1024)
+
+/* how long we will wait, at most, between restarts of a
+   streaming collector that keeps dying on us, and how long
+   it has to stay up before we consider it healthy again. */
+#define BACKOFF_MAX 300
+#define BACKOFF_OK  60
+
+/* start a collector, with its stdout going to a new pipe.
+   simple commands were split into an argv at config load, and
+   are exec'd directly; anything else goes through /bin/sh. */
+static int spawn(struct job *job, struct collector *c, int null)
+{
+	int rc, pfd[2];
+	pid_t pid;
+	int64_t t0;
+	struct timespec tv;
+
+	rc = pipe(pfd);
+	if (rc != 0) {
+		debugf("pipe failed: %s\n", strerror(errno));
+		return 1;
+	}
+	cloexec(pfd[0]);
+	cloexec(pfd[1]); /* launch() dup2()s it onto stdout */
+
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	t0 = (int64_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+	pid = launch(c->argv, null, pfd[1], foreground ? -1 : null);
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	spawn_usec += (int64_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000 - t0;
+	nspawns++;
+
+	close(pfd[1]);
+	if (pid < 0) {
+		debugf("failed to start `%s': %s\n", c->cmd, strerror(errno));
+		close(pfd[0]);
+		return 1;
+	}
+
+	debugf("child [%i] running `%s'\n", pid, c->cmd);
+	nonblocking(pfd[0]);
+
+	job->pid    = pid;
+	job->fd     = pfd[0];
+	job->c      = c;
+	scanner_init(&job->out, pfd[0], LINE_MAX_BYTES);
+	job->exited = 0;
+	job->status = 0;
+	job->cpu    = 0;
+	job->started = now_ms();
+	job->kill_at = (c->timeout && c->type == COLLECTOR_EXEC) ? job->started + c->timeout * 1000 : 0;
 	return 0;
 }
 
+static void reap(struct job *jobs, int n)
+{
+	int i, st;
+	pid_t pid;
+	struct rusage ru;
+
+	while ((pid = wait4(-1, &st, WNOHANG, &ru)) > 0) {
+		for (i = 0; i < n; i++) {
+			if (jobs[i].pid != pid)
+				continue;
+			jobs[i].exited = 1;
+			jobs[i].status = st;
+			jobs[i].cpu    = (ru.ru_utime.tv_sec  + ru.ru_stime.tv_sec)  * 1000L
+			               + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+			break;
+		}
+	}
+}
+
+/* read whatever the collector has written so far, and parse
+   each complete line; partial lines stay buffered until the
+   rest of them shows up (or the collector closes its stdout) */
+static void drain(struct job *job)
+{
+	char *line;
+
+	while ((line = scanner_line(&job->out, NULL)) != NULL)
+		parse_line(job->c, line);
+
+	nbad += job->out.overlong;
+	job->out.overlong = 0;
+	if (job->out.eof) {
+		close(job->fd);
+		job->fd = -1;
+	}
+}
+
+/* how long a collector run took, in wall clock and CPU time */
+static void timed(struct collector *c, long wall, long cpu)
+{
+	char name[128];
+
+	c->runs++;
+	c->wall = wall;
+	c->cpu  = cpu;
+
+	snprintf(name, sizeof(name), "collector.%s.wall_ms", c->name);
+	self_metric("SAMPLE", name, "%li", wall);
+	if (cpu >= 0) {
+		snprintf(name, sizeof(name), "collector.%s.cpu_ms", c->name);
+		self_metric("SAMPLE", name, "%li", cpu);
+	}
+}
+
+/* endpoints are numbered in the order they were given (-e) */
+static void endpoint_metric(int i, const char *type, const char *stat, unsigned long v)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "endpoint.%i.%s", i, stat);
+	self_metric(type, name, "%lu", v);
+}
+
+/* report on our own health: how much CPU and memory we are
+   using, how many lines we have parsed, how backed up the
+   queue and spool are, and how well compression is doing. */
+static void report(void)
+{
+	struct rusage ru;
+	char name[64];
+	int i;
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		self_metric("RATE",   "cpu_ms", "%li",
+			(ru.ru_utime.tv_sec  + ru.ru_stime.tv_sec)  * 1000L
+		  + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000);
+		self_metric("SAMPLE", "maxrss_kb", "%li", ru.ru_maxrss);
+	}
+	if (getrusage(RUSAGE_CHILDREN, &ru) == 0)
+		self_metric("RATE",   "collectors.cpu_ms", "%li",
+			(ru.ru_utime.tv_sec  + ru.ru_stime.tv_sec)  * 1000L
+		  + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000);
+
+	self_metric("RATE",   "spawns",      "%lu", nspawns);
+	self_metric("RATE",   "spawn.usec",  "%lu", spawn_usec);
+	self_metric("RATE",   "lines",       "%lu", nlines);
+	self_metric("RATE",   "lines.bad",   "%lu", nbad);
+	self_metric("RATE",   "send.errors", "%lu", __atomic_load_n(&send_errors, __ATOMIC_RELAXED));
+	self_metric("RATE",   "send.eagain", "%lu", __atomic_load_n(&send_eagain, __ATOMIC_RELAXED));
+	self_metric("SAMPLE", "aggregate.series", "%lu", aggregate_series(A));
+	if (ndedup) {
+		static unsigned long last_seen = 0, last_suppressed = 0;
+
+		self_metric("RATE",   "dedup.suppressed", "%lu", nsuppressed);
+		self_metric("SAMPLE", "dedup.series",     "%lu", aggregate_series(D));
+		if (ndedup > last_seen)
+			self_metric("SAMPLE", "dedup.ratio", "%0.3f",
+				(double)(nsuppressed - last_suppressed) / (ndedup - last_seen));
+		last_seen       = ndedup;
+		last_suppressed = nsuppressed;
+	}
+	for (i = 0; i < M->n; i++) {
+		snprintf(name, sizeof(name), "rule.%i.hits", i);
+		self_metric("RATE", name, "%lu", M->rule[i].hits);
+	}
+	for (i = 0; F->n > 1 && i < F->n; i++) {
+		struct endpoint *e = &F->ep[i];
+		endpoint_metric(i, "SAMPLE", "up",      __atomic_load_n(&e->down,    __ATOMIC_RELAXED) == 0);
+		endpoint_metric(i, "RATE",   "sent",    __atomic_load_n(&e->sent,    __ATOMIC_RELAXED));
+		endpoint_metric(i, "RATE",   "errors",  __atomic_load_n(&e->errors,  __ATOMIC_RELAXED));
+		endpoint_metric(i, "RATE",   "eagain",  __atomic_load_n(&e->eagain,  __ATOMIC_RELAXED));
+		endpoint_metric(i, "RATE",   "skipped", __atomic_load_n(&e->skipped, __ATOMIC_RELAXED));
+	}
+	self_metric("SAMPLE", "queue.depth",   "%lu", queue_depth(Q));
+	self_metric("RATE",   "queue.dropped", "%lu", queue_dropped(Q));
+	if (S) {
+		self_metric("SAMPLE", "spool.depth",   "%lu", spool_depth(S));
+		self_metric("RATE",   "spool.dropped", "%lu", spool_dropped(S));
+	}
+	if (zalgo != COMPRESS_NONE) {
+		static unsigned long last_in = 0, last_out = 0;
+		unsigned long in  = __atomic_load_n(&zin,  __ATOMIC_RELAXED);
+		unsigned long out = __atomic_load_n(&zout, __ATOMIC_RELAXED);
+
+		self_metric("RATE", "compress.in",   "%lu", in);
+		self_metric("RATE", "compress.out",  "%lu", out);
+		self_metric("RATE", "compress.usec", "%lu", __atomic_load_n(&zusec, __ATOMIC_RELAXED));
+		if (out > last_out)
+			self_metric("SAMPLE", "compress.ratio", "%0.2f",
+				(double)(in - last_in) / (out - last_out));
+		last_in  = in;
+		last_out = out;
+	}
+}
+
+/* the collectors we are running, and the job table that runs
+   them.  the first `nstreams' job slots belong to the streaming
+   collectors; the rest (max_jobs of them) are for per-interval
+   runs.  `pending' is a ring of collectors that have come due,
+   but are still waiting on a free job slot. */
+static struct registry   *R        = NULL;
+static struct job        *jobs     = NULL;
+static int                njobs    = 0;
+static int                nstreams = 0;
+static int                running  = 0;
+static struct pollfd     *pfds     = NULL;
+static struct collector **pending  = NULL;
+static size_t             phead, npending, pcap;
+
+static void defer(struct collector *c)
+{
+	pending[(phead + npending++) % pcap] = c;
+}
+
+static struct collector* undefer(void)
+{
+	struct collector *c = pending[phead];
+	phead = (phead + 1) % pcap;
+	npending--;
+	return c;
+}
+
+/* read the config file into a new registry, and its metric:
+   lines into a new set of `rules'; returns NULL if the file
+   can't be read.  bad lines are skipped, as always. */
+static struct registry* load(const char *file, struct rules **rules)
+{
+	struct scanner conf = { 0 };
+	struct registry *r;
+	struct collector *c;
+	char *a, *b;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "failed to read %s: %s\n", file, strerror(errno));
+		return NULL;
+	}
+	r = registry_new();
+	*rules = rules_new();
+	if (!r || !*rules) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+
+	scanner_init(&conf, fd, LINE_MAX_BYTES);
+	while ((a = scanner_line(&conf, NULL)) != NULL) {
+		for (; *a && isspace(*a); a++);
+		if (!*a || *a == '#') continue;
+		for (b = a + strlen(a); b > a && isspace(b[-1]); *--b = '\0');
+
+		if (strncmp(a, "metric:", 7) == 0) {
+			debugf("read rule `%s'\n", a);
+			if (rules_add(*rules, a + 7) > 0) {
+				fprintf(stderr, "out of memory\n");
+				exit(2);
+			}
+			continue;
+		}
+
+		debugf("read command `%s'\n", a);
+		c = configure(a);
+		if (!c)
+			continue;
+		if (registry_add(r, c) != 0) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+	}
+	if (conf.overlong)
+		fprintf(stderr, "skipped %lu overlong lines in %s\n", conf.overlong, file);
+	close(fd);
+	scanner_free(&conf);
+	return r;
+}
+
+static int by_line(const void *a, const void *b)
+{
+	return strcmp((*(struct collector **)a)->line,
+	              (*(struct collector **)b)->line);
+}
+
+/* start running the collectors in `next', in place of the ones
+   we have now.  collectors whose config lines haven't changed
+   carry on as they were (same schedule, same stream process);
+   the rest are started or stopped.  runs already in progress
+   for collectors that have gone away are left to finish. */
+static void install(struct registry *next, int *added, int *removed)
+{
+	struct collector **was, **now, *c;
+	struct job *tbl;
+	size_t i, j, n;
+	int nj, ns;
+
+	*added = *removed = 0;
+
+	/* pair up old and new collectors by config line */
+	was = calloc(R->n + 1, sizeof(struct collector *));
+	now = calloc(next->n + 1, sizeof(struct collector *));
+	if (!was || !now) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	memcpy(was, R->all, R->n * sizeof(struct collector *));
+	for (j = 0; j < next->n; j++) {
+		now[j] = next->all[j];
+		now[j]->slot = j;
+	}
+	qsort(was, R->n,    sizeof(struct collector *), by_line);
+	qsort(now, next->n, sizeof(struct collector *), by_line);
+
+	for (i = j = 0; i < R->n || j < next->n; ) {
+		int cmp = i == R->n ? 1 : j == next->n ? -1 : strcmp(was[i]->line, now[j]->line);
+		if (cmp == 0) {
+			next->all[now[j]->slot] = was[i];
+			collector_free(now[j]);
+			i++; j++;
+		} else if (cmp < 0) {
+			debugf("stopping `%s'\n", was[i]->line);
+			was[i]->retired = 1;
+			(*removed)++;
+			i++;
+		} else {
+			debugf("starting `%s'\n", now[j]->line);
+			(*added)++;
+			j++;
+		}
+	}
+	free(now);
+
+	/* build a new job table; streams that are staying keep
+	   their slots (and processes), per-interval runs carry on */
+	for (ns = 0, j = 0; j < next->n; j++)
+		if (next->all[j]->type == COLLECTOR_STREAM)
+			ns++;
+	nj  = ns + max_jobs;
+	tbl = calloc(nj, sizeof(struct job));
+	pfds = realloc(pfds, (nj + 3) * sizeof(struct pollfd));
+	if (!tbl || !pfds) {
+		fprintf(stderr, "failed to allocate job table: %s\n", strerror(errno));
+		exit(2);
+	}
+	for (j = 0; j < (size_t)nj; j++)
+		tbl[j].fd = -1;
+
+	for (n = 0, i = 0; i < (size_t)nstreams; i++) {
+		c = jobs[i].c;
+		if (!c->retired) {
+			tbl[n++] = jobs[i];
+			continue;
+		}
+		if (jobs[i].pid)
+			kill(-jobs[i].pid, SIGTERM);
+		if (jobs[i].fd >= 0)
+			close(jobs[i].fd);
+		scanner_free(&jobs[i].out);
+		c->busy = 0;
+	}
+	for (j = 0; j < next->n; j++) {
+		c = next->all[j];
+		if (c->type != COLLECTOR_STREAM || c->busy)
+			continue;
+		c->busy = 1; /* i.e. it has a slot */
+		tbl[n].c       = c;
+		tbl[n].stream  = 1;
+		tbl[n].backoff = 1;
+		n++;
+	}
+	for (i = nstreams; i < (size_t)njobs; i++)
+		tbl[ns + i - nstreams] = jobs[i];
+
+	free(jobs);
+	jobs     = tbl;
+	njobs    = nj;
+	nstreams = ns;
+
+	/* anything still waiting on a slot can keep waiting,
+	   unless it's gone */
+	struct collector **ring = calloc(next->n + 1, sizeof(struct collector *));
+	if (!ring) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	for (n = 0; npending; ) {
+		c = undefer();
+		if (c->retired)
+			c->busy = 0;
+		else
+			ring[n++] = c;
+	}
+	free(pending);
+	pending  = ring;
+	pcap     = next->n + 1;
+	phead    = 0;
+	npending = n;
+
+	/* everything that runs on a schedule goes on the new heap;
+	   new collectors get their first run lined up */
+	int64_t t = now_ms();
+	for (j = 0; j < next->n; j++) {
+		c = next->all[j];
+		if (c->type == COLLECTOR_STREAM)
+			continue;
+		if (!c->next) {
+			c->next = first_run(t, c->interval);
+			debugf("`%s' runs every %is, first in %lims\n", c->cmd, c->interval / 1000,
+				(long)(c->next - t));
+		}
+		registry_schedule(next, c);
+	}
+
+	/* retired collectors that are mid-run are freed when they finish */
+	for (i = 0; i < R->n; i++)
+		if (was[i]->retired && !was[i]->busy)
+			collector_free(was[i]);
+	free(was);
+
+	registry_free(R);
+	R = next;
+}
+
+/* re-read the config, and run what it says to from now on */
+static void reload(void)
+{
+	int64_t t = now_ms();
+	int added, removed;
+	struct registry *next;
+	struct rules *rules;
+
+	next = load(config, &rules);
+	if (!next) {
+		fprintf(stderr, "reload of %s failed; carrying on with the old config\n", config);
+		self_metric("COUNTER", "reload.failures", "1");
+		return;
+	}
+	install(next, &added, &removed);
+	rules_free(M);
+	M = rules;
+
+	t = now_ms() - t;
+	fprintf(stderr, "reloaded %s in %lims: %i collectors added, %i removed, %lu total\n",
+		config, (long)t, added, removed, (unsigned long)R->n);
+	self_metric("COUNTER", "reloads",   "1");
+	self_metric("SAMPLE",  "reload.ms", "%li", (long)t);
+}
+
+/* -P: instead of running collectors, push a capture (see -W)
+   through the queue and the sender, at -x times the speed it
+   was recorded at, with timestamps moved up to the present.
+   with -k, each metric goes out once per made-up host, with
+   "-0", "-1", ... tacked on to the first part of its name.
+
+   once it's all been handed over, the sender is stopped and
+   the sockets closed, with PLAY_LINGER ms for 0MQ to get the
+   last of it out, so the rate covers actual delivery. */
+#define PLAY_LINGER 30000
+static int play(const char *file, pthread_t sender_tid, void *zmq)
+{
+	struct capture *cap;
+	struct metric *m;
+	struct timespec ts;
+	int64_t usec, first = -1, start, due, t, noted;
+	unsigned long n = 0, total = 0;
+	char now[16], name[1024], *f[METRIC_FRAMES], *colon;
+	int i, k;
+
+	cap = capture_open(file);
+	if (!cap)
+		return 2;
+
+	start = noted = now_us(CLOCK_MONOTONIC);
+	while ((m = capture_read(cap, &usec)) != NULL) {
+		if (first < 0)
+			first = usec;
+		if (replay_speed > 0) {
+			due = start + (usec - first) / replay_speed;
+			if ((t = now_us(CLOCK_MONOTONIC)) < due) {
+				ts.tv_sec  = (due - t) / 1000000;
+				ts.tv_nsec = (due - t) % 1000000 * 1000;
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		snprintf(now, sizeof(now), "%li", (long)time(NULL));
+		for (i = 0; i < METRIC_FRAMES; i++)
+			f[i] = i < m->n ? m->frame[i] : NULL;
+		if (m->n > 1)
+			f[1] = now;
+
+		for (k = 0; k < replay_hosts; k++) {
+			if (replay_hosts > 1 && m->n > 2) {
+				colon = strchr(m->frame[2], ':');
+				snprintf(name, sizeof(name), "%.*s-%i%s",
+					colon ? (int)(colon - m->frame[2]) : (int)strlen(m->frame[2]),
+					m->frame[2], k, colon ? colon : "");
+				f[2] = name;
+			}
+			if (submit(m->n, f[0], f[1], f[2], f[3], f[4]) == 0)
+				total++;
+		}
+		free(m);
+		n++;
+
+		if ((t = now_us(CLOCK_MONOTONIC)) - noted >= 10000000) {
+			unsigned long sent = __atomic_load_n(&ndelivered, __ATOMIC_RELAXED);
+			fprintf(stderr, "replayed %lu metrics so far, %0.1f/s\n",
+				sent, sent / ((t - start) / 1e6));
+			noted = t;
+		}
+	}
+	if (cap->bad)
+		fprintf(stderr, "%s is corrupt after %lu records; stopping there\n", file, n);
+	else if (cap->cut)
+		debugf("%s ends part way through a record\n", file);
+	capture_close(cap);
+
+	/* wait for the sender to catch up, then for 0MQ */
+	while (__atomic_load_n(&nsent, __ATOMIC_RELAXED) < total)
+		usleep(1000);
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+	queue_wake(Q);
+	pthread_join(sender_tid, NULL);
+	fanout_close(F, PLAY_LINGER);
+	zmq_ctx_term(zmq);
+
+	t = now_us(CLOCK_MONOTONIC) - start;
+	unsigned long sent = __atomic_load_n(&ndelivered, __ATOMIC_RELAXED);
+	fprintf(stderr, "replayed %lu of %lu metrics (%lu recorded, for %i hosts) in %0.3fs: %0.1f metrics/s\n",
+		sent, total, n, replay_hosts, t / 1e6, t ? sent / (t / 1e6) : 0.0);
+	return sent == total ? 0 : 1;
+}
+
 int main(int argc, char **argv)
 {
 	int i, rc;
-	char buf[8192];
-	FILE *io;
 	pid_t pid;
-	void *zmq = NULL, *z = NULL;
+	void *zmq = NULL;
 
 	for (i = 1; i < argc; i++) {
 		if (strcmp(argv[i], "-i") == 0) {
@@ -103,7 +1354,134 @@ int main(int argc, char **argv)
 		}
 		if (strcmp(argv[i], "-e") == 0) {
 			if (!argv[++i]) bail();
-			endpoint = argv[i];
+			if (nendpoints == MAX_ENDPOINTS) {
+				fprintf(stderr, "too many endpoints (-e); %i at most\n", MAX_ENDPOINTS);
+				exit(1);
+			}
+			endpoints[nendpoints++] = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-E") == 0) {
+			if (!argv[++i]) bail();
+			fpolicy = fanout_policy(argv[i]);
+			if (fpolicy < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-j") == 0) {
+			if (!argv[++i]) bail();
+			max_jobs = atoi(argv[i]);
+			if (max_jobs < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-t") == 0) {
+			if (!argv[++i]) bail();
+			timeout = atoi(argv[i]);
+			continue;
+		}
+		if (strcmp(argv[i], "-q") == 0) {
+			if (!argv[++i]) bail();
+			qsize = strtoul(argv[i], NULL, 10);
+			if (qsize < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-Q") == 0) {
+			if (!argv[++i]) bail();
+			qpolicy = queue_policy(argv[i]);
+			if (qpolicy < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-s") == 0) {
+			if (!argv[++i]) bail();
+			spool_dir = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-S") == 0) {
+			if (!argv[++i]) bail();
+			spool_size = strtoul(argv[i], NULL, 10);
+			if (spool_size < 1 || spool_size > SPOOL_MAX / (1024 * 1024)) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-r") == 0) {
+			if (!argv[++i]) bail();
+			replay_rate = atoi(argv[i]);
+			if (replay_rate < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-b") == 0) {
+			if (!argv[++i]) bail();
+			batch_max = atoi(argv[i]);
+			if (batch_max < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-B") == 0) {
+			if (!argv[++i]) bail();
+			batch_size = strtoul(argv[i], NULL, 10);
+			if (batch_size < 1 || batch_size > BATCH_MAX / 1024) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-z") == 0) {
+			if (!argv[++i]) bail();
+			zalgo = compress_algorithm(argv[i]);
+			if (zalgo < 0) {
+				fprintf(stderr, "unsupported compression algorithm '%s'\n", argv[i]);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "-Z") == 0) {
+			if (!argv[++i]) bail();
+			zlevel = atoi(argv[i]);
+			continue;
+		}
+		if (strcmp(argv[i], "-p") == 0) {
+			if (!argv[++i]) bail();
+			self_prefix = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-R") == 0) {
+			local_rates = 1;
+			continue;
+		}
+		if (strcmp(argv[i], "-A") == 0) {
+			if (!argv[++i]) bail();
+			rollup = atoi(argv[i]);
+			if (rollup < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-d") == 0) {
+			if (!argv[++i]) bail();
+			dedup = atoi(argv[i]);
+			if (dedup < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-W") == 0) {
+			if (!argv[++i]) bail();
+			record_to = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-P") == 0) {
+			if (!argv[++i]) bail();
+			replay_from = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-x") == 0) {
+			if (!argv[++i]) bail();
+			replay_speed = strtod(argv[i], NULL);
+			if (replay_speed < 0) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-k") == 0) {
+			if (!argv[++i]) bail();
+			replay_hosts = atoi(argv[i]);
+			if (replay_hosts < 1) bail();
+			continue;
+		}
+		if (strcmp(argv[i], "-w") == 0) {
+			watch = 1;
+			continue;
+		}
+		if (strcmp(argv[i], "-n") == 0) {
+			splay = 0;
 			continue;
 		}
 		if (strcmp(argv[i], "-F") == 0) {
@@ -117,19 +1495,51 @@ int main(int argc, char **argv)
 		bail();
 	}
 
-	int null = open("/dev/null", O_RDWR);
+	int null = open("/dev/null", O_RDWR | O_CLOEXEC);
 	if (null < 0) {
 		fprintf(stderr, "/dev/null: %s\n", strerror(errno));
 		exit(1);
 	}
 
-	io = fopen(config, "r");
-	if (!io) {
-		fprintf(stderr, "failed to read %s: %s\n", config, strerror(errno));
+	if (gethostname(self, sizeof(self) - 1) != 0)
+		strcpy(self, "localhost");
+	if (!self_prefix) {
+		self_prefix = malloc(strlen(self) + sizeof(":tinybolo"));
+		if (!self_prefix) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+		sprintf(self_prefix, "%s:tinybolo", self);
+	}
+
+	A = aggregate_new();
+	D = aggregate_new();
+	if (!A || !D) {
+		fprintf(stderr, "out of memory\n");
 		exit(2);
 	}
 
-	if (!foreground) {
+	/* we chdir to / below, and need to find it again to reload */
+	char *path = realpath(config, NULL);
+	if (path)
+		config = path;
+	struct registry *initial = NULL;
+	if (replay_from) {
+		/* make sure every last metric gets there */
+		qpolicy = QUEUE_BLOCK;
+	} else {
+		initial = load(config, &M);
+		if (!initial)
+			exit(2);
+	}
+
+	if (record_to) {
+		W = capture_create(record_to);
+		if (!W)
+			exit(2);
+	}
+
+	if (!foreground && !replay_from) {
 		rc = chdir("/");
 		if (rc != 0) {
 			fprintf(stderr, "failed to chdir to /: %s\n", strerror(errno));
@@ -157,156 +1567,345 @@ int main(int argc, char **argv)
 		exit(2);
 	}
 
-	z = zmq_socket(zmq, ZMQ_PUSH);
-	if (!z) {
-		fprintf(stderr, "failed to create a 0MQ socket: %s\n", zmq_strerror(errno));
+	F = fanout_new(zmq, endpoints, nendpoints ? nendpoints : 1, fpolicy, spool_dir != NULL);
+	if (!F)
 		exit(2);
+
+	Q = queue_new(qsize, qpolicy);
+	if (!Q) {
+		fprintf(stderr, "failed to allocate metric queue: %s\n", strerror(errno));
+		exit(2);
+	}
+
+	if (spool_dir) {
+		S = spool_open(spool_dir, spool_size * 1024 * 1024);
+		if (!S)
+			exit(2);
+		debugf("spooling to %s (%lu metrics already spooled)\n", spool_dir, spool_depth(S));
+	}
+
+	if (zalgo != COMPRESS_NONE && !batch_max) {
+		fprintf(stderr, "compression (-z) only works with batching (-b)\n");
+		exit(1);
+	}
+	if (batch_max) {
+		noutboxes = fpolicy == FANOUT_SHARD ? F->n : 1;
+		outboxes  = calloc(noutboxes, sizeof(struct outbox));
+		for (i = 0; outboxes && i < noutboxes; i++) {
+			outboxes[i].m = calloc(batch_max, sizeof(struct metric *));
+			if (!outboxes[i].m || batch_init(&outboxes[i].b, batch_size * 1024) != 0)
+				break;
+		}
+		if (i < noutboxes) {
+			fprintf(stderr, "failed to allocate batch buffer: %s\n", strerror(errno));
+			exit(2);
+		}
+	}
+	if (zalgo != COMPRESS_NONE) {
+		zcap = compress_bound(zalgo, batch_size * 1024);
+		zbuf = malloc(zcap);
+		if (!zbuf) {
+			fprintf(stderr, "failed to allocate compression buffer: %s\n", strerror(errno));
+			exit(2);
+		}
 	}
 
-	rc = zmq_connect(z, endpoint);
+	pthread_t tid;
+	rc = pthread_create(&tid, NULL, sender, NULL);
 	if (rc != 0) {
-		fprintf(stderr, "failed to connect to '%s': %s\n", endpoint, zmq_strerror(errno));
+		fprintf(stderr, "failed to start sender thread: %s\n", strerror(rc));
 		exit(2);
 	}
+	if (replay_from)
+		exit(play(replay_from, tid, zmq));
 
-	int off = 0, n = 0;
-	char *a, *b;
-	while (fgets(buf, 8192, io) != NULL) {
-		for (a = buf; *a && isspace(*a); a++);
-		if (!*a || *a == '#') continue;
+	rc = pipe(sigpipe);
+	if (rc != 0) {
+		fprintf(stderr, "failed to create signal pipe: %s\n", strerror(errno));
+		exit(2);
+	}
+	cloexec(sigpipe[0]); nonblocking(sigpipe[0]);
+	cloexec(sigpipe[1]); nonblocking(sigpipe[1]);
 
-		for (b = a; *b && *b != '\n'; b++);
-		*b = '\0';
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sa.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+	sigaction(SIGHUP,  &sa, NULL);
 
-		debugf("read command `%s'\n", a);
+	int added, removed;
+	R = registry_new();
+	if (!R) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	install(initial, &added, &removed);
 
-		n = strlen(a) + 1;
-		if (off + n > COMMAND_MAX - 1) {
-			fprintf(stderr, "too many collectors defined!  truncating...\n");
-			break;
+	/* with -w, reload whenever the config file is written to,
+	   or replaced; we watch the directory, since editors and
+	   config management tools like to rename files into place */
+	int ifd = -1;
+	char *base = strrchr(config, '/') + 1;
+	if (watch) {
+		ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		base[-1] = '\0';
+		rc = ifd < 0 ? -1 : inotify_add_watch(ifd, *config ? config : "/",
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		base[-1] = '/';
+		if (rc < 0) {
+			fprintf(stderr, "failed to watch %s: %s\n", config, strerror(errno));
+			exit(2);
 		}
-		memcpy(commands + off, a, n);
-		off += n;
 	}
-	fclose(io);
+
+	/* all of our timekeeping is against the monotonic clock;
+	   poll() sleeps until the timerfd says the next thing is
+	   due, so wall clock steps and slow wakeups don't accumulate
+	   into drift. */
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd < 0) {
+		fprintf(stderr, "failed to create timer: %s\n", strerror(errno));
+		exit(2);
+	}
 
 	debugf("starting main loop\n");
-	char *cmd;
+	struct collector *c;
+	int nfds;
+	int64_t t = now_ms(), next_report = t + interval * 1000, reload_at = 0, wake;
+	int64_t next_flush = t + 1000;
+	struct itimerspec its;
 	for (;;) {
-		cmd = commands;
-		while (*cmd) {
-			int pfd[2];
-			rc = pipe(pfd);
-			if (rc != 0) {
-				debugf("pipe failed: %s\n", strerror(errno));
+		t = now_ms();
+
+		if (reload_at && reload_at <= t) {
+			reload_at = 0;
+			reload();
+		}
+
+		/* (re)start any streaming collectors that need it */
+		for (i = 0; i < nstreams; i++) {
+			if (jobs[i].pid || jobs[i].respawn > t)
 				continue;
+			if (spawn(&jobs[i], jobs[i].c, null) != 0) {
+				jobs[i].respawn = t + jobs[i].backoff * 1000;
+				if (jobs[i].backoff < BACKOFF_MAX)
+					jobs[i].backoff *= 2;
 			}
+		}
 
-			pid = fork();
-			if (pid < 0) {
-				debugf("fork failed: %s\n", strerror(errno));
+		/* queue up whatever has come due */
+		while ((c = registry_due(R, t)) != NULL) {
+			if (c->busy) {
+				debugf("`%s' is still running; skipping this run\n", c->cmd);
+				self_metric("COUNTER", "overruns", "1");
+				c->overruns++;
+			} else {
+				c->busy = 1;
+				defer(c);
+			}
+			while (c->next <= t)
+				c->next += c->interval;
+			registry_schedule(R, c);
+		}
+
+		/* start as many pending collectors as we are allowed;
+		   builtins run right here, and don't need a job slot */
+		for (i = nstreams; npending; ) {
+			c = pending[phead];
+			if (c->type == COLLECTOR_BUILTIN) {
+				struct timespec t0, t1;
+				int64_t began = now_ms();
+				undefer();
+				clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+				run_builtin(c);
+				clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+				timed(c, now_ms() - began, (t1.tv_sec - t0.tv_sec) * 1000L
+				                     + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+				c->busy = 0;
 				continue;
 			}
-			if (pid == 0) {
-				close(pfd[0]);
-
-				rc = dup2(null, 0);
-				if (rc < 0)
-					debugf("failed to redirect stdin < /dev/null: %s\n", strerror(errno));
-
-				rc = dup2(pfd[1], 1);
-				if (rc < 0)
-					debugf("failed to redirect stdout > (pipe): %s\n", strerror(errno));
-
-				if (!foreground) {
-					rc = dup2(null, 2);
-					if (rc < 0)
-						debugf("failed to redirect stderr > /dev/null: %s\n", strerror(errno));
-				}
-
-				execl("/bin/sh", "sh", "-c", cmd, NULL);
-				debugf("exec failed: %s\n", strerror(errno));
-				exit(0);
+
+			while (i < njobs && jobs[i].pid)
+				i++;
+			if (i >= njobs)
+				break;
+
+			undefer();
+			if (spawn(&jobs[i], c, null) == 0)
+				running++;
+			else
+				c->busy = 0;
+			i++;
+		}
+
+		/* send any finished rollups along (and let go of series
+		   we haven't seen in a while); once a second is plenty */
+		if (next_flush <= t) {
+			aggregate_flush(A, t, rolled_up);
+			aggregate_flush(D, t, rolled_up); /* just to drop stale series */
+			next_flush = t + 1000;
+		}
+
+		if (next_report <= t) {
+			report();
+			while (next_report <= t)
+				next_report += interval * 1000;
+		}
+
+		/* figure out when something else (a scheduled run, a
+		   respawn, a timeout, a report) needs our attention */
+		wake = next_report;
+		if (reload_at && reload_at < wake)
+			wake = reload_at;
+		if (aggregate_series(A) && next_flush < wake)
+			wake = next_flush;
+		if (R->nheap && registry_next(R) < wake)
+			wake = registry_next(R);
+		for (i = 0; i < njobs; i++) {
+			if (jobs[i].stream && !jobs[i].pid) {
+				if (jobs[i].respawn < wake)
+					wake = jobs[i].respawn;
+				continue;
 			}
+			if (!jobs[i].pid || !jobs[i].kill_at)
+				continue;
 
-			debugf("child [%i] running `%s'\n", pid, cmd);
-			close(pfd[1]);
-			io = fdopen(pfd[0], "r");
-			if (!io) {
-				debugf("fdopen failed: %s\n", strerror(errno));
-				close(pfd[0]);
+			if (jobs[i].kill_at <= t) {
+				/* out of time; kill it, keep whatever it has already
+				   given us, and free up the slot.  if the process is
+				   stuck in the kernel (i.e. a dead NFS mount), it may
+				   not die right away, and we don't want to wait on it;
+				   the SIGCHLD handler will reap it whenever it exits. */
+				debugf("`%s' timed out; killing process group %i\n", jobs[i].c->cmd, jobs[i].pid);
+				kill(-jobs[i].pid, SIGKILL);
+				self_metric("COUNTER", "timeouts", "1");
 
-			} else {
-next:
-				while (fgets(buf, 8192, io) != NULL) {
-
-#define TOKENIZE() do { \
-	for (a = b; *a &&  isspace(*a); a++); if (!*a) goto next; \
-	for (b = a; *b && !isspace(*b); b++); if (!*b) goto next; \
-	*b++ = '\0'; \
-} while (0)
-#define REMAINDER() do { \
-	for (a = b; *a && isspace(*a); a++); \
-	for (b = a; *b && *b != '\n'; b++); *b = '\0'; \
-} while (0)
-					b = buf;
-					char *ts, *name, *val;
-
-					TOKENIZE();
-					if (strcmp(a, "STATE") == 0) {
-						debugf("STATEs are not supported\n");
-						TOKENIZE(); ts   = a;
-						TOKENIZE(); name = a;
-						TOKENIZE(); val  = a;
-						REMAINDER();
-						send_frames(z, 5, "STATE", ts, name, val, a);
-
-					} else if (strcmp(a, "COUNTER") == 0) {
-						TOKENIZE(); ts  = a;
-						TOKENIZE(); name = a;
-						REMAINDER();
-						send_frames(z, 4, "COUNTER", ts, name, FALLBACK(a, "1"));
-
-					} else if (strcmp(a, "SAMPLE") == 0) {
-						TOKENIZE(); ts   = a;
-						TOKENIZE(); name = a;
-						TOKENIZE(); val  = a;
-						send_frames(z, 4, "SAMPLE", ts, name, val);
-
-					} else if (strcmp(a, "RATE") == 0) {
-						TOKENIZE(); ts   = a;
-						TOKENIZE(); name = a;
-						TOKENIZE(); val  = a;
-						send_frames(z, 4, "RATE", ts, name, val);
-
-					} else if (strcmp(a, "EVENT") == 0) {
-						TOKENIZE(); ts   = a;
-						TOKENIZE(); name = a;
-						REMAINDER();
-						send_frames(z, 4, "EVENT", ts, name, FALLBACK(a, ""));
-					}
-#undef TOKENIZE
-#undef REMAINDER
-				}
+				jobs[i].c->timeouts++;
+				timed(jobs[i].c, t - jobs[i].started, -1);
+				jobs[i].c->busy = 0;
+				if (jobs[i].c->retired)
+					collector_free(jobs[i].c);
+				if (jobs[i].fd >= 0)
+					close(jobs[i].fd);
+				scanner_free(&jobs[i].out);
+				memset(&jobs[i], 0, sizeof(struct job));
+				jobs[i].fd = -1;
+				running--;
+				wake = t;
+				continue;
 			}
-			fclose(io);
-			close(pfd[0]);
+			if (jobs[i].kill_at < wake)
+				wake = jobs[i].kill_at;
+		}
 
-			if (waitpid(pid, &rc, 0) < 0)
-				debugf("waitpid failed: %s\n", strerror(errno));
-			if (rc != 0)
-				debugf("`%s' exited %02x\n", cmd, rc);
+		/* an it_value of zero would disarm the timer */
+		memset(&its, 0, sizeof(its));
+		if (wake <= t)
+			wake = t + 1;
+		its.it_value.tv_sec  = wake / 1000;
+		its.it_value.tv_nsec = (wake % 1000) * 1000000;
+		timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
 
-			while (*cmd++);
+		nfds = 0;
+		pfds[nfds].fd = sigpipe[0];
+		pfds[nfds].events = POLLIN;
+		nfds++;
+		pfds[nfds].fd = tfd;
+		pfds[nfds].events = POLLIN;
+		nfds++;
+		pfds[nfds].fd = ifd; /* ignored by poll() if -1 */
+		pfds[nfds].events = POLLIN;
+		nfds++;
+		for (i = 0; i < njobs; i++) {
+			jobs[i].poll = 0;
+			if (jobs[i].fd < 0)
+				continue;
+			pfds[nfds].fd = jobs[i].fd;
+			pfds[nfds].events = POLLIN;
+			jobs[i].poll = nfds++;
+		}
+
+		/* collectors still waiting on a slot that has since
+		   freed up shouldn't wait for the next timer wake */
+		int timeout = -1;
+		for (i = nstreams; npending && i < njobs; i++) {
+			if (!jobs[i].pid) {
+				timeout = 0;
+				break;
+			}
+		}
+
+		rc = poll(pfds, nfds, timeout);
+		if (rc < 0) {
+			if (errno != EINTR)
+				debugf("poll failed: %s\n", strerror(errno));
+			continue;
 		}
 
-		debugf("sleeping for %i seconds\n", interval);
-		sleep(interval);
+		if (pfds[0].revents & POLLIN) {
+			char junk[64];
+			while (read(sigpipe[0], junk, sizeof(junk)) > 0);
+			reap(jobs, njobs);
+			if (hupped) {
+				hupped = 0;
+				reload_at = now_ms();
+			}
+		}
+		if (pfds[1].revents & POLLIN) {
+			uint64_t ticks;
+			if (read(tfd, &ticks, sizeof(ticks)) < 0) { /* spurious */ }
+		}
+		if (pfds[2].revents & POLLIN) {
+			char ev[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			struct inotify_event *e;
+			ssize_t n;
+
+			while ((n = read(ifd, ev, sizeof(ev))) > 0)
+				for (e = (void *)ev; (char *)e < ev + n; e = (void *)((char *)(e + 1) + e->len))
+					if (e->len && strcmp(e->name, base) == 0 && !reload_at)
+						/* give the writer a moment to finish up */
+						reload_at = now_ms() + 250;
+		}
+
+		t = now_ms();
+		for (i = 0; i < njobs; i++) {
+			if (jobs[i].poll && pfds[jobs[i].poll].revents)
+				drain(&jobs[i]);
+			if (!jobs[i].pid || jobs[i].fd >= 0 || !jobs[i].exited)
+				continue;
+
+			if (jobs[i].status != 0) {
+				jobs[i].c->failures++;
+				debugf("`%s' exited %02x (%lu of %lu runs failed)\n", jobs[i].c->cmd, jobs[i].status,
+					jobs[i].c->failures, jobs[i].c->runs + 1);
+			}
+
+			if (jobs[i].stream) {
+				/* streams are supposed to run forever; if it died
+				   quickly, back off before we try it again */
+				if (t - jobs[i].started >= BACKOFF_OK * 1000)
+					jobs[i].backoff = 1;
+				debugf("restarting `%s' in %i seconds\n", jobs[i].c->cmd, jobs[i].backoff);
+				jobs[i].pid     = 0;
+				jobs[i].respawn = t + jobs[i].backoff * 1000;
+				if (jobs[i].backoff < BACKOFF_MAX)
+					jobs[i].backoff *= 2;
+				continue;
+			}
+
+			timed(jobs[i].c, t - jobs[i].started, jobs[i].cpu);
+			jobs[i].c->busy = 0;
+			if (jobs[i].c->retired)
+				collector_free(jobs[i].c);
+			scanner_free(&jobs[i].out);
+			memset(&jobs[i], 0, sizeof(struct job));
+			jobs[i].fd = -1;
+			running--;
+		}
 	}
 
-	rc = 0;
-	zmq_setsockopt(z, ZMQ_LINGER, &rc, sizeof(rc));
-	zmq_close(z);
+	fanout_close(F, 0);
 	zmq_ctx_destroy(zmq);
 	return 0;
 }
@@ -0,0 +1,243 @@
+/*
+  Copyright 2015 James Hunt <james@jameshunt.us>
+
+  This file is part of tinybolo.
+
+  tinybolo is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option) any later
+  version.
+
+  tinybolo is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+  details.
+
+  You should have received a copy of the GNU General Public License along
+  with tinybolo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <zmq.h>
+
+#include "metric.h"
+#include "batch.h"
+#include "compress.h"
+
+/* tinyrelay sits between tinybolo and bolo, and turns batched
+   (and possibly compressed) metrics, see batch.h and compress.h,
+   back into individual bolo messages.
+   Without a -e endpoint to forward to, it prints what it gets
+   to standard output, one metric per line, for testing. */
+
+static int debug      = 0;
+static char *bind_to  = "tcp://*:2998";
+static char *endpoint = NULL;
+
+#define debugf(...) do { if (debug) fprintf(stderr, __VA_ARGS__); } while (0)
+
+#define MAX_FRAMES 8
+
+void bail(void)
+{
+	fprintf(stderr, "USAGE: tinyrelay -l tcp://*:2998 [-e tcp://10.0.0.1:2999] [-D]\n");
+	exit(1);
+}
+
+static int relay(void *out, struct metric *m)
+{
+	int i;
+
+	if (!out) {
+		for (i = 0; i < m->n; i++)
+			printf("%s%c", m->frame[i], i == m->n - 1 ? '\n' : ' ');
+		return 0;
+	}
+
+	if (zmq_send(out, "", 0, ZMQ_SNDMORE) < 0)
+		goto fail;
+	for (i = 0; i < m->n; i++)
+		if (zmq_send(out, m->frame[i], strlen(m->frame[i]) + 1, i == m->n - 1 ? 0 : ZMQ_SNDMORE) < 0)
+			goto fail;
+	return 0;
+
+fail:
+	fprintf(stderr, "zmq_send failed: %s\n", zmq_strerror(errno));
+	return 1;
+}
+
+static void unbatch(void *out, const char *blob, size_t len)
+{
+	struct metric *m;
+	size_t off = 0;
+	int i;
+
+	for (i = 0; (m = batch_next(blob, len, &off)) != NULL; i++) {
+		relay(out, m);
+		free(m);
+	}
+	if (off != len)
+		fprintf(stderr, "malformed batch (%lu of %lu bytes decoded)\n",
+			(unsigned long)off, (unsigned long)len);
+	debugf("relayed a batch of %i metrics\n", i);
+}
+
+/* copy a frame into a NUL-terminated string */
+static char* string(zmq_msg_t *msg)
+{
+	size_t n = zmq_msg_size(msg);
+	char *s = malloc(n + 1);
+	if (s) {
+		memcpy(s, zmq_msg_data(msg), n);
+		s[n] = '\0';
+	}
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	int i, n, rc;
+	void *zmq, *in, *out = NULL;
+	zmq_msg_t frames[MAX_FRAMES];
+	struct metric *m;
+	char *buf = NULL;   /* for decompressing into */
+	size_t cap = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-l") == 0) {
+			if (!argv[++i]) bail();
+			bind_to = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-e") == 0) {
+			if (!argv[++i]) bail();
+			endpoint = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "-D") == 0) {
+			debug = 1;
+			continue;
+		}
+		bail();
+	}
+
+	zmq = zmq_ctx_new();
+	if (!zmq) {
+		fprintf(stderr, "failed to create a 0MQ context: %s\n", zmq_strerror(errno));
+		exit(2);
+	}
+
+	in = zmq_socket(zmq, ZMQ_PULL);
+	if (!in || zmq_bind(in, bind_to) != 0) {
+		fprintf(stderr, "failed to bind to '%s': %s\n", bind_to, zmq_strerror(errno));
+		exit(2);
+	}
+
+	if (endpoint) {
+		out = zmq_socket(zmq, ZMQ_PUSH);
+		if (!out || zmq_connect(out, endpoint) != 0) {
+			fprintf(stderr, "failed to connect to '%s': %s\n", endpoint, zmq_strerror(errno));
+			exit(2);
+		}
+	}
+
+	for (;;) {
+		/* read in all the frames of the next message */
+		for (n = 0; ; ) {
+			zmq_msg_t discard, *msg = n < MAX_FRAMES ? &frames[n] : &discard;
+			zmq_msg_init(msg);
+			rc = zmq_msg_recv(msg, in, 0);
+			if (rc < 0) {
+				zmq_msg_close(msg);
+				break;
+			}
+			int more = zmq_msg_more(msg);
+			if (msg == &discard)
+				zmq_msg_close(msg);
+			else
+				n++;
+			if (!more)
+				break;
+		}
+		if (rc < 0) {
+			if (errno != EINTR)
+				fprintf(stderr, "zmq_msg_recv failed: %s\n", zmq_strerror(errno));
+			for (i = 0; i < n; i++)
+				zmq_msg_close(&frames[i]);
+			continue;
+		}
+
+		/* frame 0 is the (empty) envelope */
+		int algo = n == 3 ? compress_frame(zmq_msg_data(&frames[1]), zmq_msg_size(&frames[1])) : -1;
+		if (algo > 0) {
+			const char *blob = zmq_msg_data(&frames[2]);
+			size_t len = zmq_msg_size(&frames[2]), want = compress_length(blob, len);
+
+			if (want > BATCH_MAX) {
+				fprintf(stderr, "ignoring a batch claiming %lu bytes (max %lu)\n",
+					(unsigned long)want, (unsigned long)BATCH_MAX);
+				for (i = 0; i < n; i++)
+					zmq_msg_close(&frames[i]);
+				continue;
+			}
+			if (want > cap) {
+				free(buf);
+				buf = malloc(cap = want);
+				if (!buf)
+					cap = 0;
+			}
+			len = buf ? decompress(algo, blob, len, buf, cap) : 0;
+			if (len) {
+				debugf("decompressed %lu bytes into %lu\n",
+					(unsigned long)zmq_msg_size(&frames[2]), (unsigned long)len);
+				unbatch(out, buf, len);
+			} else {
+				fprintf(stderr, "failed to decompress a %lu-byte batch\n",
+					(unsigned long)zmq_msg_size(&frames[2]));
+			}
+
+		} else if (n == 3 && zmq_msg_size(&frames[1]) == sizeof(BATCH_FRAME)
+		 && memcmp(zmq_msg_data(&frames[1]), BATCH_FRAME, sizeof(BATCH_FRAME)) == 0) {
+			unbatch(out, zmq_msg_data(&frames[2]), zmq_msg_size(&frames[2]));
+
+		} else if (n > 1 && zmq_msg_size(&frames[1]) > sizeof(BATCH_FRAME)
+		 && memcmp(zmq_msg_data(&frames[1]), BATCH_FRAME "/", sizeof(BATCH_FRAME)) == 0) {
+			/* a compressed batch, but not one we can decompress */
+			char *name = string(&frames[1]);
+			fprintf(stderr, "unsupported compression '%s'\n",
+				name ? name + sizeof(BATCH_FRAME) : "?");
+			free(name);
+
+		} else if (n > 1 && n - 1 <= METRIC_FRAMES) {
+			char *f[METRIC_FRAMES] = { 0 };
+			for (i = 1; i < n; i++)
+				f[i - 1] = string(&frames[i]);
+
+			for (i = 0; i < n - 1 && f[i]; i++);
+			m = i == n - 1 ? metric_new(n - 1, f[0], f[1], f[2], f[3], f[4]) : NULL;
+			if (m) {
+				relay(out, m);
+				free(m);
+			}
+			for (i = 0; i < n - 1; i++)
+				free(f[i]);
+
+		} else {
+			fprintf(stderr, "ignoring a %i-frame message\n", n);
+		}
+
+		fflush(stdout);
+		for (i = 0; i < n; i++)
+			zmq_msg_close(&frames[i]);
+	}
+
+	zmq_close(in);
+	if (out)
+		zmq_close(out);
+	zmq_ctx_destroy(zmq);
+	return 0;
+}